@@ -5,13 +5,35 @@
 #include "bench.h"
 #include "GCanvas.h"
 #include "GBitmap.h"
+#include "GPicture.h"
 #include "GTime.h"
+#include <atomic>
 #include <memory>
+#include <new>
 #include <string>
 #include <vector>
 #include <sys/stat.h>
 #include <unistd.h>
 
+/*
+ *  Count every trip through the global allocator, so --allocs can report how many heap
+ *  allocations a warmed-up canvas makes per draw. Atomic, since with --threads the canvas's
+ *  workers allocate too.
+ */
+static std::atomic<size_t> gAllocCount;
+
+void* operator new(size_t size) {
+    gAllocCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
 static void setup_bitmap(GBitmap* bitmap, int w, int h) {
     size_t rb = w * sizeof(GPixel);
     bitmap->reset(w, h, rb, (GPixel*)calloc(h, rb), GBitmap::kNo_IsOpaque);
@@ -23,11 +45,19 @@ enum Mode {
     kOnce,
 };
 
-static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap, Mode mode) {
+/* GDrawCounters, averaged over the steady-state draws */
+struct DrawMix {
+    double solid, context, lowp, highp, verts;
+};
+
+/* With a picture, each draw plays it back instead of calling bench->draw() */
+static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap, Mode mode,
+                          int threads, const GPicture* picture, double* allocsPerDraw,
+                          DrawMix* mix) {
     GISize size = bench->size();
     setup_bitmap(bitmap, size.fWidth, size.fHeight);
 
-    auto canvas = GCreateCanvas(*bitmap);
+    auto canvas = GCreateCanvas(*bitmap, GCanvasOptions(threads));
     if (!canvas) {
         fprintf(stderr, "failed to create canvas for [%d %d] %s\n",
                 size.fWidth, size.fHeight, bench->name());
@@ -46,14 +76,70 @@ static double handle_proc(GBenchmark* bench, const char path[], GBitmap* bitmap,
         case kOnce: N = 4; break;
     }
 
+    // the first draw warms up the canvas, only the ones after it count as steady-state
+    size_t warmAllocs = 0;
     GMSec now = GTime::GetMSec();
     for (int i = 0; i < N || forever; ++i) {
-        bench->draw(canvas.get());
+        if (picture) {
+            picture->playback(canvas.get());
+        } else {
+            bench->draw(canvas.get());
+        }
+        canvas->flush();
+        if (i == 0) {
+            warmAllocs = gAllocCount.load(std::memory_order_relaxed);
+            GResetDrawCounters();
+        }
     }
     GMSec dur = GTime::GetMSec() - now;
+    *allocsPerDraw = N > 1 ? (gAllocCount.load(std::memory_order_relaxed) - warmAllocs) * 1.0 / (N - 1) : 0;
+
+    const GDrawCounters counters = GGetDrawCounters();
+    const double steady = N > 1 ? N - 1 : 1;
+    *mix = { counters.solid / steady, counters.context / steady, counters.lowp / steady,
+             counters.highp / steady, counters.vertexTransforms / steady };
     return dur * 1.0 / N;
 }
 
+static bool same_pixels(const GBitmap& a, const GBitmap& b) {
+    if (a.width() != b.width() || a.height() != b.height()) {
+        return false;
+    }
+    for (int y = 0; y < a.height(); ++y) {
+        if (memcmp(a.getAddr(0, y), b.getAddr(0, y), a.width() * sizeof(GPixel))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ *  Times the bench on 1, 2, 4, 8 and 16 threads, and checks each thread count draws exactly the
+ *  pixels one thread does.
+ */
+static void handle_scaling(GBenchmark* bench, const char name[], Mode mode) {
+    const int threadCounts[] = { 1, 2, 4, 8, 16 };
+    GBitmap serial;
+    printf("%s", name);
+    for (int threads : threadCounts) {
+        GBitmap bm;
+        double allocs;
+        DrawMix mix;
+        double dur = handle_proc(bench, name, &bm, mode, threads, nullptr, &allocs, &mix);
+        printf(" %dt %g", threads, dur);
+        if (threads == 1) {
+            serial = bm;
+            continue;
+        }
+        if (!same_pixels(serial, bm)) {
+            printf(" (pixels differ)");
+        }
+        free(bm.pixels());
+    }
+    printf("\n");
+    free(serial.pixels());
+}
+
 static bool is_arg(const char arg[], const char name[]) {
     std::string str("--");
     str += name;
@@ -92,6 +178,11 @@ int main(int argc, char** argv) {
     std::vector<double> inScores;
     bool chatty_mode = true;
     bool write_images = false;
+    bool show_allocs = false;
+    bool show_counters = false;
+    bool use_picture = false;
+    bool scaling = false;
+    int threads = 1;
 
     int count = -1;
     while (gBenchFactories[++count]);
@@ -116,6 +207,16 @@ int main(int argc, char** argv) {
             chatty_mode = false;
         } else if (is_arg(argv[i], "writeImages")) {
             write_images = true;
+        } else if (is_arg(argv[i], "allocs")) {
+            show_allocs = true;
+        } else if (is_arg(argv[i], "counters")) {
+            show_counters = true;
+        } else if (is_arg(argv[i], "picture")) {
+            use_picture = true;
+        } else if (is_arg(argv[i], "threads") && i+1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "scaling")) {
+            scaling = true;
         } else {
             printf("Unknown arg %s\n", argv[i]);
             return -1;
@@ -136,11 +237,42 @@ int main(int argc, char** argv) {
         if (match && !strstr(name, match)) {
             continue;
         }
+        if (scaling) {
+            handle_scaling(bench.get(), name, mode);
+            continue;
+        }
 
         GBitmap testBM;
-        double dur = handle_proc(bench.get(), name, &testBM, mode);
+        double allocs;
+        DrawMix mix;
+        double dur = handle_proc(bench.get(), name, &testBM, mode, threads, nullptr, &allocs, &mix);
         if (chatty_mode) {
             printf("%s %g", name, dur);
+            if (bench->bytesPerDraw() > 0 && dur > 0) {
+                printf(" %.1f GB/s", bench->bytesPerDraw() / (dur * 1e6));
+            }
+        }
+        if (use_picture) {
+            // record one draw, then time playing back the optimized picture in its place
+            auto recorder = GCreateRecordingCanvas();
+            bench->draw(recorder.get());
+            auto picture = recorder->finishRecording();
+
+            free(testBM.pixels());
+            double pictureAllocs;
+            DrawMix pictureMix;
+            double pictureDur = handle_proc(bench.get(), name, &testBM, mode, threads,
+                                            picture.get(), &pictureAllocs, &pictureMix);
+            printf(" picture %g saved %.1f%% ops %d/%d", pictureDur,
+                   dur > 0 ? 100 * (dur - pictureDur) / dur : 0.0,
+                   picture->opCount(), picture->recordedOpCount());
+        }
+        if (show_allocs) {
+            printf(" allocs/draw %g", allocs);
+        }
+        if (show_counters) {
+            printf(" solid %g context %g lowp %g highp %g verts %g", mix.solid, mix.context,
+                   mix.lowp, mix.highp, mix.verts);
         }
         if (inScores.size()) {
             if (chatty_mode) {
@@ -19,6 +19,9 @@ public:
     virtual GISize size() const = 0;
     virtual void draw(GCanvas*) = 0;
 
+    // Bytes of pixels one draw() writes, if the bench wants its bandwidth reported
+    virtual double bytesPerDraw() const { return 0; }
+
     typedef GBenchmark* (*Factory)();
 };
 
@@ -9,6 +9,7 @@
 #include "GRandom.h"
 #include "GRect.h"
 #include <string>
+#include <vector>
 
 static GColor rand_color(GRandom& rand, bool forceOpaque = false) {
     GColor c { rand.nextF(), rand.nextF(), rand.nextF(), rand.nextF() };
@@ -68,6 +69,31 @@ public:
     }
 };
 
+/* Full canvas fills, the case that is all memory bandwidth */
+class FillBench : public GBenchmark {
+    const GISize    fSize;
+    const GColor    fColor;
+    const GBlendMode fMode;
+    const int       fLoops;
+    const char*     fName;
+public:
+    FillBench(GISize size, GColor color, GBlendMode mode, int loops, const char* name)
+        : fSize(size), fColor(color), fMode(mode), fLoops(loops), fName(name) {}
+
+    const char* name() const override { return fName; }
+    GISize size() const override { return fSize; }
+    double bytesPerDraw() const override {
+        return (double)fSize.fWidth * fSize.fHeight * sizeof(GPixel) * fLoops;
+    }
+    void draw(GCanvas* canvas) override {
+        GPaint paint(fColor);
+        paint.setBlendMode(fMode);
+        for (int i = 0; i < fLoops; ++i) {
+            canvas->drawPaint(paint);
+        }
+    }
+};
+
 #include "bench_pa2.inc"
 #include "bench_pa3.inc"
 #include "bench_pa4.inc"
@@ -83,6 +109,15 @@ const GBenchmark::Factory gBenchFactories[] {
     []() -> GBenchmark* {
         return new SingleRectBench({1000,1000}, GRect::LTRB(500, 500, 502, 502), "rect_tiny");
     },
+    []() -> GBenchmark* {
+        return new FillBench({7680, 4320}, {0, 0, 0, 0}, GBlendMode::kClear, 1, "clear_8k");
+    },
+    []() -> GBenchmark* {
+        return new FillBench({7680, 4320}, {1, 0.5, 0.25, 1}, GBlendMode::kSrcOver, 1, "paint_opaque_8k");
+    },
+    []() -> GBenchmark* {
+        return new FillBench({512, 512}, {1, 0.5, 0.25, 0.5}, GBlendMode::kSrc, 20, "paint_src_512");
+    },
 
     // pa2
     []() -> GBenchmark* { return new PolyRectsBench(false); },
@@ -96,6 +131,12 @@ const GBenchmark::Factory gBenchFactories[] {
     // pa3
     []() -> GBenchmark* { return new BitmapBench("apps/spock.png", "bitmap_opaque"); },
     []() -> GBenchmark* { return new BitmapBench("apps/oldwell.png", "bitmap_alpha"); },
+    []() -> GBenchmark* { return new BitmapBench("apps/spock.png", "bitmap_bilinear",
+                                                 GShader::kClamp, GShader::kBilinear); },
+    []() -> GBenchmark* { return new BitmapBench("apps/spock.png", "bitmap_bicubic",
+                                                 GShader::kClamp, GShader::kBicubic); },
+    []() -> GBenchmark* { return new DownscaleBench("bitmap_downscale_nearest", GShader::kNearest); },
+    []() -> GBenchmark* { return new DownscaleBench("bitmap_downscale_mip", GShader::kBilinear); },
 
     // pa4
     []() -> GBenchmark* {
@@ -110,6 +151,18 @@ const GBenchmark::Factory gBenchFactories[] {
         const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }, {0, 1, 0, 0}};
         return new GradientBench(colors, 3, "gradient_3");
     },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }, {0, 1, 0, 0}};
+        return new RadialGradientBench(colors, 3, "gradient_radial_3");
+    },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }, {0, 1, 0, 0}};
+        return new ConicalGradientBench(colors, 3, "gradient_conical_3");
+    },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }, {0, 1, 0, 0}};
+        return new SweepGradientBench(colors, 3, "gradient_sweep_3");
+    },
     []() -> GBenchmark* { return new PathBench("path_small", 0.1f, false); },
     []() -> GBenchmark* { return new PathBench("path_big",   1.0f, false); },
     []() -> GBenchmark* { return new PathBench("path_bigc",  1.0f,  true); },
@@ -129,12 +182,36 @@ const GBenchmark::Factory gBenchFactories[] {
         const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }};
         return new GradientBench(colors, 2, "gradient_2_mirror", GShader::kMirror);
     },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }, {0, 1, 0, 0}};
+        return new GradientBench(colors, 3, "gradient_3_vertical", GShader::kClamp, {0, 200});
+    },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }, {0, 1, 0, 0}};
+        return new GradientBench(colors, 3, "gradient_3_horizontal", GShader::kClamp, {200, 0});
+    },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }};
+        return new RadialGradientBench(colors, 2, "gradient_radial_2_repeat", GShader::kRepeat);
+    },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }};
+        return new ConicalGradientBench(colors, 2, "gradient_conical_2_mirror", GShader::kMirror);
+    },
+    []() -> GBenchmark* {
+        const GColor colors[] = {{ 1, 0, 0, 1 }, { 0, 1, 1, 1 }};
+        return new SweepGradientBench(colors, 2, "gradient_sweep_2_mirror", GShader::kMirror);
+    },
 
     // extra benches for tiling bitmaps
     []() -> GBenchmark* { return new BitmapBench("apps/spock.png", "bitmap_repeat",
                                                  GShader::kRepeat); },
     []() -> GBenchmark* { return new BitmapBench("apps/spock.png", "bitmap_mirror",
                                                  GShader::kMirror); },
+    []() -> GBenchmark* { return new BitmapBench("apps/spock.png", "bitmap_repeat_bilinear",
+                                                 GShader::kRepeat, GShader::kBilinear); },
+    []() -> GBenchmark* { return new BitmapBench("apps/spock.png", "bitmap_mirror_bicubic",
+                                                 GShader::kMirror, GShader::kBicubic); },
 
     // pa6
     []() -> GBenchmark* {
@@ -154,6 +231,10 @@ const GBenchmark::Factory gBenchFactories[] {
         const int indices[] = { 0, 1, 2,  2, 3, 0 };
         return new MeshBench(verts, colors, verts, 2, indices, "mesh_both");
      },
+     []() -> GBenchmark* { return new DenseMeshBench; },
+     []() -> GBenchmark* { return new QuadBench(8, "quad_level8"); },
+     []() -> GBenchmark* { return new QuadBench(GCanvas::kAutoQuadLevel, "quad_auto"); },
+     []() -> GBenchmark* { return new WarpBench; },
 
     nullptr,
 };
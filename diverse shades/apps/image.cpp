@@ -6,7 +6,11 @@
 #include "GCanvas.h"
 #include "GColor.h"
 #include "GBitmap.h"
+#include "GMatrix.h"
+#include "GPaint.h"
+#include "GPicture.h"
 #include <string>
+#include <vector>
 
 static int pixel_diff(GPixel p0, GPixel p1) {
     int da = abs(GPixel_GetA(p0) - GPixel_GetA(p1));
@@ -57,10 +61,10 @@ static double compare(const GBitmap& a, const GBitmap& b, int tolerance, bool ve
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
 
-static void handle_proc(const GDrawRec& rec, const char path[], GBitmap* bitmap) {
+static void handle_proc(const GDrawRec& rec, const char path[], GBitmap* bitmap, int threads) {
     bitmap->alloc(rec.fWidth, rec.fHeight);
 
-    auto canvas = GCreateCanvas(*bitmap);
+    auto canvas = GCreateCanvas(*bitmap, GCanvasOptions(threads));
     if (!canvas) {
         fprintf(stderr, "failed to create canvas for [%d %d] %s\n",
                 rec.fWidth, rec.fHeight, rec.fName);
@@ -69,12 +73,197 @@ static void handle_proc(const GDrawRec& rec, const char path[], GBitmap* bitmap)
 
     canvas->clear({0, 0, 0, 0});
     rec.fDraw(canvas.get());
+    canvas->flush();
 
     if (!bitmap->writeToFile(path)) {
         fprintf(stderr, "failed to write %s\n", path);
     }
 }
 
+/*
+ *  Forwards every call to another canvas, noting whether any of them draws with a shader.
+ */
+class ShaderSpyCanvas : public GCanvas {
+public:
+    ShaderSpyCanvas(GCanvas* canvas) : fCanvas(canvas), fSawShader(false) {}
+
+    bool sawShader() const { return fSawShader; }
+
+    void save() override { fCanvas->save(); }
+    void restore() override { fCanvas->restore(); }
+    void concat(const GMatrix& matrix) override { fCanvas->concat(matrix); }
+
+    void drawPaint(const GPaint& paint) override {
+        note(paint);
+        fCanvas->drawPaint(paint);
+    }
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+        note(paint);
+        fCanvas->drawRect(rect, paint);
+    }
+    void drawConvexPolygon(const GPoint pts[], int count, const GPaint& paint) override {
+        note(paint);
+        fCanvas->drawConvexPolygon(pts, count, paint);
+    }
+    void drawPath(const GPath& path, const GPaint& paint) override {
+        note(paint);
+        fCanvas->drawPath(path, paint);
+    }
+    void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[], int count,
+                  const int indices[], const GPaint& paint) override {
+        note(paint);
+        fCanvas->drawMesh(verts, colors, texs, count, indices, paint);
+    }
+    void drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4], int level,
+                  const GPaint& paint) override {
+        note(paint);
+        fCanvas->drawQuad(verts, colors, texs, level, paint);
+    }
+
+private:
+    void note(const GPaint& paint) {
+        fSawShader = fSawShader || paint.getShader() != nullptr;
+    }
+
+    GCanvas* fCanvas;
+    bool fSawShader;
+};
+
+/*
+ *  Records each draw into a picture of its own and plays it back into every target right away,
+ *  while its shader is still alive. save, restore and concat go straight to the targets.
+ */
+class DrawByDrawCanvas : public GCanvas {
+public:
+    DrawByDrawCanvas(const std::vector<GCanvas*>& targets)
+        : fTargets(targets), fRecorder(GCreateRecordingCanvas()) {}
+
+    void save() override {
+        for (GCanvas* target : fTargets) {
+            target->save();
+        }
+    }
+    void restore() override {
+        for (GCanvas* target : fTargets) {
+            target->restore();
+        }
+    }
+    void concat(const GMatrix& matrix) override {
+        for (GCanvas* target : fTargets) {
+            target->concat(matrix);
+        }
+    }
+
+    void drawPaint(const GPaint& paint) override {
+        fRecorder->drawPaint(paint);
+        playback();
+    }
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+        fRecorder->drawRect(rect, paint);
+        playback();
+    }
+    void drawConvexPolygon(const GPoint pts[], int count, const GPaint& paint) override {
+        fRecorder->drawConvexPolygon(pts, count, paint);
+        playback();
+    }
+    void drawPath(const GPath& path, const GPaint& paint) override {
+        fRecorder->drawPath(path, paint);
+        playback();
+    }
+    void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[], int count,
+                  const int indices[], const GPaint& paint) override {
+        fRecorder->drawMesh(verts, colors, texs, count, indices, paint);
+        playback();
+    }
+    void drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4], int level,
+                  const GPaint& paint) override {
+        fRecorder->drawQuad(verts, colors, texs, level, paint);
+        playback();
+    }
+
+private:
+    void playback() {
+        auto picture = fRecorder->finishRecording();
+        for (GCanvas* target : fTargets) {
+            picture->playback(target);
+        }
+    }
+
+    std::vector<GCanvas*> fTargets;
+    std::unique_ptr<GRecordingCanvas> fRecorder;
+};
+
+static bool same_pixels(const GBitmap& a, const GBitmap& b) {
+    for (int y = 0; y < a.height(); ++y) {
+        if (memcmp(a.getAddr(0, y), b.getAddr(0, y), a.width() * sizeof(GPixel))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ *  Records rec into a picture and plays it back under an identity, a scaled and a rotated CTM,
+ *  each of which has to give exactly the pixels drawing rec directly under it does. Returns how
+ *  many don't. A picture needs its shaders for as long as it is played back, and rec's are
+ *  gone once it returns, so a rec that draws with shaders is played back a draw at a time
+ *  (*drawByDraw is set) instead of as one optimized picture.
+ */
+static int check_picture(const GDrawRec& rec, int threads, bool* drawByDraw) {
+    auto recorder = GCreateRecordingCanvas();
+    ShaderSpyCanvas spy(recorder.get());
+    rec.fDraw(&spy);
+    auto picture = recorder->finishRecording();
+    *drawByDraw = spy.sawShader();
+
+    const float cx = rec.fWidth * 0.5f;
+    const float cy = rec.fHeight * 0.5f;
+    const GMatrix ctms[] = {
+        GMatrix(),
+        GMatrix::Scale(0.6f, 1.3f),
+        GMatrix::Translate(cx, cy) * GMatrix::Rotate(0.3f) * GMatrix::Translate(-cx, -cy),
+    };
+    const char* names[] = { "identity", "scaled", "rotated" };
+    const int count = GARRAY_COUNT(ctms);
+
+    GBitmap direct[count], played[count];
+    std::unique_ptr<GCanvas> canvases[count];
+    std::vector<GCanvas*> targets;
+    for (int i = 0; i < count; ++i) {
+        direct[i].alloc(rec.fWidth, rec.fHeight);
+        auto canvas = GCreateCanvas(direct[i], GCanvasOptions(threads));
+        canvas->clear({0, 0, 0, 0});
+        canvas->concat(ctms[i]);
+        rec.fDraw(canvas.get());
+        canvas->flush();
+
+        played[i].alloc(rec.fWidth, rec.fHeight);
+        canvases[i] = GCreateCanvas(played[i], GCanvasOptions(threads));
+        canvases[i]->clear({0, 0, 0, 0});
+        canvases[i]->concat(ctms[i]);
+        if (!*drawByDraw) {
+            picture->playback(canvases[i].get());
+        }
+        targets.push_back(canvases[i].get());
+    }
+    if (*drawByDraw) {
+        DrawByDrawCanvas canvas(targets);
+        rec.fDraw(&canvas);
+    }
+
+    int failures = 0;
+    for (int i = 0; i < count; ++i) {
+        canvases[i]->flush();
+        if (!same_pixels(direct[i], played[i])) {
+            printf("- picture of %s differs %s\n", rec.fName, names[i]);
+            failures += 1;
+        }
+        free(direct[i].pixels());
+        free(played[i].pixels());
+    }
+    return failures;
+}
+
 static bool is_arg(const char arg[], const char name[]) {
     std::string str("--");
     str += name;
@@ -181,6 +370,11 @@ int main(int argc, char** argv) {
     int tolerance = 0;
     int targetPA = -1;
     int oneShot = -1;
+    int threads = 1;
+    bool pictures = false;
+    int pictureRecs = 0;
+    int pictureDrawByDraw = 0;
+    int pictureFailures = 0;
 
     const char* collage_dir = nullptr;
     int collage_index = -1;
@@ -217,6 +411,10 @@ int main(int argc, char** argv) {
         } else if (is_arg(argv[i], "tolerance") && i+1 < argc) {
             tolerance = atoi(argv[++i]);
             assert(tolerance >= 0);
+        } else if (is_arg(argv[i], "threads") && i+1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "picture")) {
+            pictures = true;
         } else if (is_arg(argv[i], "scoreFile") && i+1 < argc) {
             scoreFile = argv[++i];
         } else if (is_arg(argv[i], "diff") && i+1 < argc) {
@@ -295,7 +493,14 @@ int main(int argc, char** argv) {
         }
         
         GBitmap testBM;
-        handle_proc(gDrawRecs[i], path.c_str(), &testBM);
+        handle_proc(gDrawRecs[i], path.c_str(), &testBM, threads);
+
+        if (pictures && !something) {
+            bool drawByDraw;
+            pictureFailures += check_picture(gDrawRecs[i], threads, &drawByDraw);
+            pictureRecs += 1;
+            pictureDrawByDraw += drawByDraw;
+        }
 
         if (expected && !something) {
             std::string exp_path(expected);
@@ -345,6 +550,10 @@ int main(int argc, char** argv) {
     if (expected && (oneShot < 0)) {
         printf("           image: %d\n", image_score);
     }
+    if (pictures) {
+        printf("         picture: %d recs (%d with shaders, a draw at a time), %d mismatches\n",
+               pictureRecs, pictureDrawByDraw, pictureFailures);
+    }
     if (reportFile) {
         fprintf(reportFile, "%s, image, %d\n", author, image_score);
     }
@@ -29,8 +29,28 @@ class CheckerShader : public GShader {
     const GMatrix fLocalMatrix;
     const GPixel fP0, fP1;
 
-    GMatrix fInverse;
-    
+    class CheckerContext : public Context {
+        const GMatrix fInverse;
+        const GPixel fP0, fP1;
+
+    public:
+        CheckerContext(const GMatrix& inverse, GPixel p0, GPixel p1)
+            : fInverse(inverse), fP0(p0), fP1(p1) {}
+
+        void shadeRow(int x, int y, int count, GPixel row[]) override {
+            const float dx = fInverse[GMatrix::SX];
+            const float dy = fInverse[GMatrix::KY];
+            GPoint loc = fInverse * GPoint{x + 0.5f, y + 0.5f};
+
+            const GPixel array[] = { fP0, fP1 };
+            for (int i = 0; i < count; ++i) {
+                row[i] = array[((int)loc.fX + (int)loc.fY) & 1];
+                loc.fX += dx;
+                loc.fY += dy;
+            }
+        }
+    };
+
 public:
     CheckerShader(float scale, GPixel p0, GPixel p1)
         : fLocalMatrix(GMatrix::Scale(scale, scale))
@@ -38,25 +58,16 @@ public:
         , fP1(p1)
     {}
     
-    bool isOpaque() override {
+    bool isOpaque() const override {
         return GPixel_GetA(fP0) == 0xFF && GPixel_GetA(fP1) == 0xFF;
     }
     
-    bool setContext(const GMatrix& ctm) override {
-        return (ctm * fLocalMatrix).invert(&fInverse);
-    }
-    
-    void shadeRow(int x, int y, int count, GPixel row[]) override {
-        const float dx = fInverse[GMatrix::SX];
-        const float dy = fInverse[GMatrix::KY];
-        GPoint loc = fInverse * GPoint{x + 0.5f, y + 0.5f};
-        
-        const GPixel array[] = { fP0, fP1 };
-        for (int i = 0; i < count; ++i) {
-            row[i] = array[((int)loc.fX + (int)loc.fY) & 1];
-            loc.fX += dx;
-            loc.fY += dy;
+    std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+        GMatrix inverse;
+        if (!(ctm * fLocalMatrix).invert(&inverse)) {
+            return nullptr;
         }
+        return std::unique_ptr<Context>(new CheckerContext(inverse, fP0, fP1));
     }
 };
 
@@ -181,3 +181,69 @@ static void draw_mirror_ramp(GCanvas* canvas) {
         y += h;
     }
 }
+
+/* One column per tile mode, each cell with make(row, mode)'s origin at its own top left */
+template <typename Make> static void draw_tile_modes(GCanvas* canvas, float w, float h, int rows, Make make) {
+    const GShader::TileMode modes[] = { GShader::kClamp, GShader::kRepeat, GShader::kMirror };
+    for (int row = 0; row < rows; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            auto sh = make(row, modes[col]);
+            canvas->save();
+            canvas->concat(GMatrix::Translate(col * (w + 4), row * (h + 4)));
+            canvas->drawRect(GRect::WH(w, h), GPaint(sh.get()));
+            canvas->restore();
+        }
+    }
+}
+
+/*
+ *  Rows: radial, conical with the circles apart, conical with a == 0 (|c1 - c0| == |r1 - r0|,
+ *  so only one root), conical with one circle inside the other, and sweep.
+ */
+static void draw_gradient_tiling(GCanvas* canvas) {
+    const GColor colors[] = {
+        {1, 0, 0, 1}, {0, 0.5f, 1, 0.5f}, {1, 1, 0, 1},
+    };
+    canvas->clear({1, 1, 1, 1});
+    draw_tile_modes(canvas, 164, 90, 5, [&](int row, GShader::TileMode mode) {
+        switch (row) {
+            case 0: return GCreateRadialGradient({80, 45}, 25, colors, 3, mode);
+            case 1: return GCreateTwoPointConicalGradient({30, 45}, 8, {90, 40}, 20, colors, 3, mode);
+            case 2: return GCreateTwoPointConicalGradient({50, 20}, 6, {80, 60}, 56, colors, 3, mode);
+            case 3: return GCreateTwoPointConicalGradient({70, 45}, 10, {85, 50}, 40, colors, 3, mode);
+            default: return GCreateSweepGradient({80, 45}, 0.5f, 2.5f, colors, 3, mode);
+        }
+    });
+}
+
+/*
+ *  Rows: spock shrunk and turned with kBilinear, then kBicubic (sampling a mip level), and a
+ *  4x4 bitmap blown up with each, which makes the seams between tiles easy to see.
+ */
+static void draw_filter_tiling(GCanvas* canvas) {
+    GPixel pixels[16] = {
+        GPixel_PackARGB(255, 255, 0, 0), GPixel_PackARGB(255, 0, 255, 0),
+        GPixel_PackARGB(255, 0, 0, 255), GPixel_PackARGB(128, 128, 128, 0),
+        GPixel_PackARGB(255, 255, 255, 255), GPixel_PackARGB(255, 0, 0, 0),
+        GPixel_PackARGB(64, 0, 64, 64), GPixel_PackARGB(255, 255, 0, 255),
+        GPixel_PackARGB(255, 0, 255, 255), GPixel_PackARGB(0, 0, 0, 0),
+        GPixel_PackARGB(255, 255, 255, 0), GPixel_PackARGB(255, 64, 64, 64),
+        GPixel_PackARGB(192, 0, 0, 192), GPixel_PackARGB(255, 128, 0, 255),
+        GPixel_PackARGB(255, 255, 128, 0), GPixel_PackARGB(255, 0, 128, 0),
+    };
+    const GBitmap tiny(4, 4, 4 * sizeof(GPixel), pixels, false);
+    GBitmap spock;
+    spock.readFromFile("apps/spock.png");
+
+    canvas->clear({1, 1, 1, 1});
+    draw_tile_modes(canvas, 164, 120, 4, [&](int row, GShader::TileMode mode) {
+        const GShader::FilterQuality quality = row % 2 ? GShader::kBicubic : GShader::kBilinear;
+        if (row < 2) {
+            const GMatrix m = GMatrix::Translate(20, 10) * GMatrix::Rotate(0.4f) * GMatrix::Scale(0.2f, 0.2f);
+            return GCreateBitmapShader(spock, m, mode, quality);
+        }
+        const GMatrix m = GMatrix::Translate(60, 30) * GMatrix::Rotate(0.2f) * GMatrix::Scale(11, 9);
+        return GCreateBitmapShader(tiny, m, mode, quality);
+    });
+    free(spock.pixels());
+}
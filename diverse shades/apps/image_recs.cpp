@@ -40,6 +40,8 @@ const GDrawRec gDrawRecs[] = {
     { draw_cartman,     512, 512,   "cartman", 5 },
     { draw_divided,     512, 512,   "divided", 5 },
     { draw_mirror_ramp, 512, 512,   "mirror_ramp", 5 },
+    { draw_gradient_tiling, 500, 470, "gradient_tiling", 5 },
+    { draw_filter_tiling,   500, 492, "filter_tiling",   5 },
 
     { draw_tri,         512, 512,   "tri_color",   6 },
     { draw_tri2,        512, 512,   "tri_texture", 6 },
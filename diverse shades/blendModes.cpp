@@ -188,19 +188,84 @@ GPixel kXor(const GPixel src, const GPixel dst) { //(1 - Sa)*D + (1 - Da)*S
 }
 
 
-blendProc getProc(const GBlendMode mode) {
-    return blendtypes[static_cast<int>(mode)];
+template <blendProc proc> void scalarRow(const GPixel src[], GPixel dst[], int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = proc(src[i], dst[i]);
+    }
 }
 
-blendProc getProc(const GBlendMode mode, const GPixel src) {
-    int sa = GPixel_GetA(src);
-    //if (sa == 255 && mode == GBlendMode::kSrcOver) { //go through other blendmodes and optimize here, focus on src
-    //    return kSrc;
-    //}
+template <blendProc proc> void scalarSolid(GPixel dst[], GPixel src, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = proc(src, dst[i]);
+    }
+}
 
-    if (sa == 0 && (mode == GBlendMode::kSrcIn || mode == GBlendMode::kDstIn || mode == GBlendMode::kSrcOut || mode == GBlendMode::kDstATop)) {
-        return kClear;
+const blendRowProc scalarRowProcs[kBlendModeCount] = {
+    scalarRow<kClear>,
+    scalarRow<kSrc>,
+    scalarRow<kDst>,
+    scalarRow<kSrcOver>,
+    scalarRow<kDstOver>,
+    scalarRow<kSrcIn>,
+    scalarRow<kDstIn>,
+    scalarRow<kSrcOut>,
+    scalarRow<kDstOut>,
+    scalarRow<kSrcATop>,
+    scalarRow<kDstATop>,
+    scalarRow<kXor>,
+};
+
+const blendSolidProc scalarSolidProcs[kBlendModeCount] = {
+    scalarSolid<kClear>,
+    scalarSolid<kSrc>,
+    scalarSolid<kDst>,
+    scalarSolid<kSrcOver>,
+    scalarSolid<kDstOver>,
+    scalarSolid<kSrcIn>,
+    scalarSolid<kDstIn>,
+    scalarSolid<kSrcOut>,
+    scalarSolid<kDstOut>,
+    scalarSolid<kSrcATop>,
+    scalarSolid<kDstATop>,
+    scalarSolid<kXor>,
+};
+
+/*
+ *  A premultiplied src with sa = 0 is all 0, so every term it scales is gone: the modes that
+ *  only keep those store 0, and the ones that keep dst as well leave it alone.
+ *  Checked against the per-pixel procs for every premultiplied dst.
+ */
+GBlendMode reduceMode(const GBlendMode mode, const GPixel src) {
+    if (GPixel_GetA(src) != 0) {
+        return mode;
     }
+    switch (mode) {
+        case GBlendMode::kSrc:
+        case GBlendMode::kSrcIn:
+        case GBlendMode::kDstIn:
+        case GBlendMode::kSrcOut:
+        case GBlendMode::kDstATop:  return GBlendMode::kClear;
+        case GBlendMode::kSrcOver:
+        case GBlendMode::kDstOver:
+        case GBlendMode::kDstOut:
+        case GBlendMode::kSrcATop:
+        case GBlendMode::kXor:      return GBlendMode::kDst;
+        default:                    return mode;
+    }
+}
 
-    return getProc(mode);
+/*
+ *  With sa = 255 every (255 - sa) term is gone and div255(255 * x) is x, which leaves these.
+ *  Checked against the per-pixel procs for every opaque src and premultiplied dst.
+ */
+GBlendMode reduceModeOpaque(const GBlendMode mode) {
+    switch (mode) {
+        case GBlendMode::kSrcOver:  return GBlendMode::kSrc;
+        case GBlendMode::kDstIn:    return GBlendMode::kDst;
+        case GBlendMode::kDstOut:   return GBlendMode::kClear;
+        case GBlendMode::kSrcATop:  return GBlendMode::kSrcIn;
+        case GBlendMode::kDstATop:  return GBlendMode::kDstOver;
+        case GBlendMode::kXor:      return GBlendMode::kSrcOut;
+        default:                    return mode;
+    }
 }
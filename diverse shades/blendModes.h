@@ -62,11 +62,26 @@ const blendProc blendtypes[] = {
     kXor,
 };
 
-/* Get the blendmode */
-blendProc getProc(const GBlendMode mode);
+/* Blends src[0...count - 1] into dst[0...count - 1] */
+typedef void(*blendRowProc)(const GPixel src[], GPixel dst[], int count);
 
-/* get blendmode with pixel parm */
-blendProc getProc(const GBlendMode mode, const GPixel src);
+/* Blends one constant src into dst[0...count - 1] */
+typedef void(*blendSolidProc)(GPixel dst[], GPixel src, int count);
+
+const int kBlendModeCount = static_cast<int>(GBlendMode::kXor) + 1;
+
+/* Scalar reference row/solid procs, indexed by GBlendMode. The SIMD ones must match these. */
+extern const blendRowProc scalarRowProcs[kBlendModeCount];
+extern const blendSolidProc scalarSolidProcs[kBlendModeCount];
+
+/*
+ *  Returns the mode that gives the same result for a constant premultiplied src, e.g. kSrcIn of
+ *  a clear src is kClear and kSrcOver of one is kDst
+ */
+GBlendMode reduceMode(const GBlendMode mode, const GPixel src);
+
+/* Returns the mode that gives the same result when every src pixel is opaque, e.g. kSrcOver is kSrc */
+GBlendMode reduceModeOpaque(const GBlendMode mode);
 
 
 #endif
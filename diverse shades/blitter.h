@@ -0,0 +1,209 @@
+#ifndef blitter_DEFINED
+#define blitter_DEFINED
+
+#include <algorithm>
+#include <climits>
+#include <stdint.h>
+#include <vector>
+
+#include "GBitmap.h"
+#include "GPixel.h"
+#include "GRect.h"
+#include "GShader.h"
+#include "blendModes.h"
+#include "pipeline.h"
+#include "spans.h"
+
+/*
+ *  Writes the pixels for one draw. The canvas picks one of these per draw (see
+ *  my_canvas::chooseBlitter), so the scan converters only say which pixels are covered, and
+ *  never look at the paint. Blitters are the only code that writes pixels, so they are also
+ *  where the canvas clip is applied.
+ */
+class GBlitter {
+public:
+    virtual ~GBlitter() {}
+
+    /* Cover [x, x + width) on row y */
+    virtual void blitH(int x, int y, int width) = 0;
+
+    /* Cover [x, x + width) on rows [y, y + height) */
+    virtual void blitRect(int x, int y, int width, int height) {
+        for (int i = 0; i < height; i++) {
+            blitH(x, y + i, width);
+        }
+    }
+
+protected:
+    void setTarget(const GBitmap* device, const GIRect& clip) {
+        fDevice = device;
+        fClip = clip;
+    }
+
+    const GBitmap* fDevice = nullptr;
+    GIRect fClip;
+};
+
+/*
+ *  One premultiplied color, blended with the same span proc on every row. Modes whose result
+ *  doesn't depend on dst (Clear and Src, which is what the canvas reduces SrcOver and DstOut
+ *  to for an opaque color) become plain stores, which blitRect can do as one run over the
+ *  whole rect when its rows are contiguous.
+ */
+class SolidBlitter : public GBlitter {
+public:
+    void set(const GBitmap* device, const GIRect& clip, GPixel src, GBlendMode mode,
+             const SpanProcs& spans) {
+        setTarget(device, clip);
+        fSpans = &spans;
+        fSrc = mode == GBlendMode::kClear ? 0 : src;
+        fStore = mode == GBlendMode::kClear || mode == GBlendMode::kSrc;
+        fProc = spans.solid[static_cast<int>(fStore ? GBlendMode::kSrc : mode)];
+    }
+
+    void blitH(int x, int y, int width) override {
+        if (y < fClip.fTop || y >= fClip.fBottom) {
+            return;
+        }
+        int left = std::max(x, fClip.fLeft);
+        int right = std::min(x + width, fClip.fRight);
+        if (left < right) {
+            fProc(fDevice->getAddr(left, y), fSrc, right - left);
+        }
+    }
+
+    void blitRect(int x, int y, int width, int height) override {
+        int left = std::max(x, fClip.fLeft);
+        int right = std::min(x + width, fClip.fRight);
+        int top = std::max(y, fClip.fTop);
+        int bottom = std::min(y + height, fClip.fBottom);
+        if (left >= right || top >= bottom) {
+            return;
+        }
+        if (fStore) {
+            storeRect(left, top, right - left, bottom - top);
+            return;
+        }
+        for (int row = top; row < bottom; row++) {
+            fProc(fDevice->getAddr(left, row), fSrc, right - left);
+        }
+    }
+
+private:
+    /* Fills this big would only evict everything else from the cache, so they go around it */
+    enum { kStreamBytes = 8 << 20 };
+
+    void storeRect(int x, int y, int width, int height) {
+        GPixel* addr = fDevice->getAddr(x, y);
+        const size_t rowBytes = fDevice->rowBytes();
+        const bool stream = (size_t)width * height * sizeof(GPixel) >= kStreamBytes;
+        blendSolidProc store = stream ? fSpans->fillStream : fProc;
+
+        /* whole rows with no padding between them are one long run */
+        if (width == fDevice->width() && rowBytes == width * sizeof(GPixel) &&
+            (int64_t)width * height <= INT_MAX) {
+            store(addr, fSrc, width * height);
+            return;
+        }
+        for (int row = 0; row < height; row++) {
+            store(addr, fSrc, width);
+            addr = (GPixel*)((char*)addr + rowBytes);
+        }
+    }
+
+    const SpanProcs* fSpans;
+    GPixel fSrc;
+    blendSolidProc fProc;
+    bool fStore;    // fProc just stores fSrc
+};
+
+/*
+ *  Shades each row, then blends it in. Only the clipped part of a span is asked for, but as
+ *  part of the span from its real left edge (Context::shadeSpan), since some contexts (e.g.
+ *  my_triShader's) step their color along the row and would round differently if they
+ *  started partway in. With kSrc the row is shaded straight into the device, so dst is only
+ *  written.
+ *
+ *  Contexts whose rows are one color each only shade one pixel per row, and blend it like a
+ *  solid color, with the mode reduced for that color: rows it leaves alone are skipped.
+ */
+class ShaderBlitter : public GBlitter {
+public:
+    void set(const GBitmap* device, const GIRect& clip, GShader::Context* context, GBlendMode mode,
+             const SpanProcs& spans) {
+        setTarget(device, clip);
+        fContext = context;
+        fProc = spans.row[static_cast<int>(mode)];
+        fSpans = &spans;
+        fMode = mode;
+        fWriteOnly = mode == GBlendMode::kSrc;
+        fConstantRows = context->kind() == GShader::Context::kConstantRows;
+    }
+
+    void blitH(int x, int y, int width) override {
+        if (y < fClip.fTop || y >= fClip.fBottom) {
+            return;
+        }
+        int start = std::max(x, 0);
+        int left = std::max(start, fClip.fLeft);
+        int right = std::min(x + width, fClip.fRight);
+        if (left >= right) {
+            return;
+        }
+        if (fConstantRows) {
+            GPixel color;
+            fContext->shadeRow(start, y, 1, &color);
+            GBlendMode mode = reduceMode(fMode, color);
+            if (GPixel_GetA(color) == 0xFF) {
+                mode = reduceModeOpaque(mode);
+            }
+            if (mode != GBlendMode::kDst) {
+                fSpans->solid[static_cast<int>(mode)](fDevice->getAddr(left, y), color, right - left);
+            }
+            return;
+        }
+        if (fWriteOnly) {
+            fContext->shadeSpan(start, left, y, right - left, fDevice->getAddr(left, y));
+            return;
+        }
+        fRow.resize(right - left);
+        fContext->shadeSpan(start, left, y, right - left, fRow.data());
+        fProc(fRow.data(), fDevice->getAddr(left, y), right - left);
+    }
+
+private:
+    std::vector<GPixel> fRow;   // blitH's shaded span, kept for its capacity
+    GShader::Context* fContext;
+    blendRowProc fProc;
+    const SpanProcs* fSpans;
+    GBlendMode fMode;
+    bool fWriteOnly;
+    bool fConstantRows;
+};
+
+/* Runs a shader's pipeline (ending in its blend) over each span, with the same edges as ShaderBlitter */
+class PipelineBlitter : public GBlitter {
+public:
+    void set(const GBitmap* device, const GIRect& clip, Pipeline* pipeline) {
+        setTarget(device, clip);
+        fPipeline = pipeline;
+    }
+
+    void blitH(int x, int y, int width) override {
+        if (y < fClip.fTop || y >= fClip.fBottom) {
+            return;
+        }
+        int start = std::max(x, 0);
+        int left = std::max(start, fClip.fLeft);
+        int right = std::min(x + width, fClip.fRight);
+        if (left >= right) {
+            return;
+        }
+        fPipeline->run(start, left, right, y, fDevice->getAddr(left, y));
+    }
+
+private:
+    Pipeline* fPipeline;
+};
+
+#endif
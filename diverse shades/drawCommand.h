@@ -0,0 +1,149 @@
+#ifndef drawCommand_DEFINED
+#define drawCommand_DEFINED
+
+#include <algorithm>
+#include <vector>
+
+#include "GCanvas.h"
+#include "GColor.h"
+#include "GPaint.h"
+#include "GPath.h"
+#include "GPoint.h"
+#include "GRect.h"
+
+/*
+ *  One draw call with its own copy of the geometry, so it can be replayed into a canvas after
+ *  the caller's arrays are gone. Used by my_tiledCanvas and by the picture recorder. The paint
+ *  is copied too, but its shader is only a pointer.
+ */
+struct DrawCommand {
+    enum Type { kPaint, kRect, kPolygon, kPath, kMesh, kQuad };
+
+    Type type;
+    GPaint paint;
+
+    std::vector<GRect> rects;   // kRect, drawn one after another with the same paint
+    GPath path;
+    int count;                  // triangles for a mesh, level for a quad
+    std::vector<GPoint> pts;
+    std::vector<GColor> colors;
+    std::vector<GPoint> texs;
+    std::vector<int> indices;
+
+    void setRect(const GRect& rect) {
+        type = kRect;
+        rects.push_back(rect);
+    }
+
+    void setPolygon(const GPoint points[], int n) {
+        type = kPolygon;
+        pts.assign(points, points + n);
+    }
+
+    void setPath(const GPath& p) {
+        type = kPath;
+        path = p;
+    }
+
+    void setMesh(const GPoint verts[], const GColor cols[], const GPoint tx[], int triangles,
+                 const int idx[]) {
+        int vertCount = 0;
+        for (int i = 0; i < triangles * 3; i++) {
+            vertCount = std::max(vertCount, idx[i] + 1);
+        }
+        type = kMesh;
+        count = triangles;
+        pts.assign(verts, verts + vertCount);
+        if (cols != nullptr) {
+            colors.assign(cols, cols + vertCount);
+        }
+        if (tx != nullptr) {
+            texs.assign(tx, tx + vertCount);
+        }
+        indices.assign(idx, idx + triangles * 3);
+    }
+
+    void setQuad(const GPoint verts[4], const GColor cols[4], const GPoint tx[4], int level) {
+        type = kQuad;
+        count = level;
+        pts.assign(verts, verts + 4);
+        if (cols != nullptr) {
+            colors.assign(cols, cols + 4);
+        }
+        if (tx != nullptr) {
+            texs.assign(tx, tx + 4);
+        }
+    }
+
+    /* The local space box around everything the draw can touch, false for kPaint (unbounded) */
+    bool bounds(GRect* r) const {
+        switch (type) {
+            case kPaint:
+                return false;
+            case kPath:
+                *r = path.bounds();
+                return true;
+            case kRect:
+                *r = rects[0];
+                for (const GRect& rect : rects) {
+                    r->fLeft = std::min(r->fLeft, rect.fLeft);
+                    r->fTop = std::min(r->fTop, rect.fTop);
+                    r->fRight = std::max(r->fRight, rect.fRight);
+                    r->fBottom = std::max(r->fBottom, rect.fBottom);
+                }
+                return true;
+            default:
+                if (pts.empty()) {
+                    *r = GRect::LTRB(0, 0, 0, 0);
+                    return true;
+                }
+                *r = GRect::LTRB(pts[0].fX, pts[0].fY, pts[0].fX, pts[0].fY);
+                for (const GPoint& p : pts) {
+                    r->fLeft = std::min(r->fLeft, p.fX);
+                    r->fTop = std::min(r->fTop, p.fY);
+                    r->fRight = std::max(r->fRight, p.fX);
+                    r->fBottom = std::max(r->fBottom, p.fY);
+                }
+                return true;
+        }
+    }
+
+    void draw(GCanvas* canvas) const {
+        switch (type) {
+            case kPaint:
+                canvas->drawPaint(paint);
+                break;
+            case kRect:
+                for (const GRect& rect : rects) {
+                    canvas->drawRect(rect, paint);
+                }
+                break;
+            case kPolygon:
+                canvas->drawConvexPolygon(pts.data(), (int)pts.size(), paint);
+                break;
+            case kPath:
+                canvas->drawPath(path, paint);
+                break;
+            case kMesh:
+                canvas->drawMesh(pts.data(), colors.size() ? colors.data() : nullptr,
+                                 texs.size() ? texs.data() : nullptr, count, indices.data(), paint);
+                break;
+            case kQuad:
+                canvas->drawQuad(pts.data(), colors.size() ? colors.data() : nullptr,
+                                 texs.size() ? texs.data() : nullptr, count, paint);
+                break;
+        }
+    }
+
+    /* drop the geometry but keep the vectors' storage for whatever is recorded here next */
+    void reset() {
+        rects.clear();
+        path = GPath();
+        pts.clear();
+        colors.clear();
+        texs.clear();
+        indices.clear();
+    }
+};
+
+#endif
@@ -81,12 +81,12 @@ struct Edge {
     }
 };
 
-Edge* createEdge(GPoint left, GPoint right, bool w) {
+Edge createEdge(GPoint left, GPoint right, bool w) {
     assert(GRoundToInt(left.y()) != GRoundToInt(right.y()));
     if (left.y() > right.y()) {
         std::swap(left, right);
     }
-    Edge* e = new Edge();
+    Edge e;
     int winding;
     if (w) {
         winding = 1;
@@ -94,7 +94,7 @@ Edge* createEdge(GPoint left, GPoint right, bool w) {
     else {
         winding = -1;
     }
-    e->set(left, right, winding);
+    e.set(left, right, winding);
 
     return e;
 }
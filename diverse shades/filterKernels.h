@@ -0,0 +1,148 @@
+#ifndef filterKernels_DEFINED
+#define filterKernels_DEFINED
+
+#include <algorithm>
+#include <stdint.h>
+
+#include "GPixel.h"
+
+/*
+ *  Bitmap filtering kernels: each output pixel is a weighted sum of 4 * Q bitmap pixels (its
+ *  taps), Q = 1 for bilinear and 4 for bicubic. The shader context has already looked up the
+ *  taps (so tiling happens there) and their weights, laid out per output pixel as Q runs of
+ *  4 taps with 4 weights each. Weights are 16 bit fixed point with 14 fraction bits, and the
+ *  weights of one pixel add up to exactly 1 << 14, so a flat area stays exactly flat.
+ *
+ *  Bicubic weights can be negative, so the sums are clamped to [0, 255] and then each color
+ *  to its alpha, to keep the result premultiplied.
+ *
+ *  The vector version is instantiated with the same traits struct T as spanKernels.h, which
+ *  for these also provides:
+ *
+ *      I32                 4 channels of T::P pixels, 32 bits each
+ *      P                   pixels filtered per step
+ *      loadTaps(p, stride), loadWeights(w, stride)
+ *                          4 taps / weights of each of the P pixels, stride apart
+ *      swapMiddle(U8)      taps [0, 1, 2, 3] -> [0, 2, 1, 3]
+ *      interleave8(a, b)   the low 8 bytes of a and b, byte by byte
+ *      upper64(U8)         the high 8 bytes moved down
+ *      pair0(U16), pair1(U16)
+ *                          weights 0, 1 (or 2, 3) repeated for every channel
+ *      madd(U16, U16)      products of neighbouring 16 bit lanes, added, as I32
+ *      add32, splat32, shr32 (arithmetic), packs32(I32, I32) -> U16
+ *      min16, max16 (signed)
+ *      storeFiltered(row, U8) the P pixels, packed as pack(v, v) leaves them
+ *
+ *  and for downsample2x2 (mip levels, see mipmap.h):
+ *
+ *      unpackLo64(a, b), unpackHi64(a, b)
+ *                          the low (high) 64 bits of each 128 bits of a and b, side by side
+ *      shr16(v, bits)      logical shift of each 16 bit lane
+ *      storeLowHalf(dst, U8)  the T::N / 2 pixels pack(v, v) made from the low halves
+ */
+namespace {
+
+/* Each dst pixel is the rounded average of a 2x2 block, so averages of premul pixels stay premul */
+inline GPixel average2x2(GPixel a, GPixel b, GPixel c, GPixel d) {
+    GPixel result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const unsigned sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) +
+                             ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+        result |= ((sum + 2) >> 2) << shift;
+    }
+    return result;
+}
+
+/* dst[i] averages pixels 2i and 2i + 1 of both rows */
+inline void downsample2x2Scalar(const GPixel row0[], const GPixel row1[], GPixel dst[], int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = average2x2(row0[2 * i], row0[2 * i + 1], row1[2 * i], row1[2 * i + 1]);
+    }
+}
+
+template <int Q>
+void filterRowScalar(const GPixel taps[], const int16_t weights[], int count, GPixel row[]) {
+    const int K = 4 * Q;
+    for (int i = 0; i < count; i++) {
+        int sum[4] = { 0, 0, 0, 0 };
+        for (int k = 0; k < K; k++) {
+            const GPixel p = taps[k];
+            const int w = weights[k];
+            for (int c = 0; c < 4; c++) {
+                sum[c] += (int)((p >> (8 * c)) & 0xFF) * w;
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            sum[c] = std::max(0, std::min(255, (sum[c] + (1 << 13)) >> 14));
+        }
+        /* byte 3 is alpha */
+        GPixel result = (GPixel)sum[3] << 24;
+        for (int c = 0; c < 3; c++) {
+            result |= (GPixel)std::min(sum[c], sum[3]) << (8 * c);
+        }
+        row[i] = result;
+        taps += K;
+        weights += K;
+    }
+}
+
+template <typename T, int Q>
+void filterRow(const GPixel taps[], const int16_t weights[], int count, GPixel row[]) {
+    typedef typename T::U8 U8;
+    typedef typename T::U16 U16;
+    typedef typename T::I32 I32;
+    const int K = 4 * Q;
+    const int P = T::P;
+
+    while (count >= P) {
+        I32 acc = T::splat32(1 << 13);
+        for (int q = 0; q < Q; q++) {
+            const U8 t = T::swapMiddle(T::loadTaps(taps + 4 * q, K));
+            const U16 w = T::loadWeights(weights + 4 * q, K);
+
+            /* channels of taps 0 and 1 side by side (then 2 and 3), to go with weights 0 and 1 */
+            const U8 pairs = T::interleave8(t, T::upper64(t));
+            acc = T::add32(acc, T::add32(T::madd(T::lo(pairs), T::pair0(w)),
+                                         T::madd(T::hi(pairs), T::pair1(w))));
+        }
+        const I32 sum = T::shr32(acc, 14);
+        U16 v = T::packs32(sum, sum);
+        v = T::min16(T::max16(v, T::splat16(0)), T::splat16(255));
+        v = T::min16(v, T::alpha(v));
+        T::storeFiltered(row, T::pack(v, v));
+
+        taps += P * K;
+        weights += P * K;
+        row += P;
+        count -= P;
+    }
+    filterRowScalar<Q>(taps, weights, count, row);
+}
+
+template <typename T>
+void downsample2x2(const GPixel row0[], const GPixel row1[], GPixel dst[], int count) {
+    typedef typename T::U8 U8;
+    typedef typename T::U16 U16;
+    const int N = T::N;
+
+    while (count >= N / 2) {
+        const U8 a = T::load(row0);
+        const U8 b = T::load(row1);
+        /* columns added first, then pixels 0 + 1, 2 + 3, ... of the sums */
+        const U16 lo = T::add(T::lo(a), T::lo(b));
+        const U16 hi = T::add(T::hi(a), T::hi(b));
+        const U16 sum = T::add(T::unpackLo64(lo, hi), T::unpackHi64(lo, hi));
+        const U16 avg = T::shr16(T::add(sum, T::splat16(2)), 2);
+        T::storeLowHalf(dst, T::pack(avg, avg));
+
+        row0 += N;
+        row1 += N;
+        dst += N / 2;
+        count -= N / 2;
+    }
+    downsample2x2Scalar(row0, row1, dst, count);
+}
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #include "GMatrix.h"
 #include "GPaint.h"
+#include <stdint.h>
 #include <string>
 
 class GBitmap;
@@ -16,6 +17,10 @@ class GRect;
 
 class GCanvas {
 public:
+    enum {
+        kAutoQuadLevel = -1,    // see drawQuad
+    };
+
     virtual ~GCanvas() {}
 
     /**
@@ -118,10 +123,19 @@ public:
      *      3---2
      *
      *  colors and/or texs can be null. The resulting triangles should be passed to drawMesh(...).
+     *
+     *  With level == kAutoQuadLevel the canvas picks the level itself, from how big the quad is
+     *  on the device and how far it (or its colors or texs) bends away from a parallelogram.
      */
     virtual void drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4],
                           int level, const GPaint&) = 0;
 
+    /**
+     *  Make sure every draw so far has landed in the bitmap. Canvases that defer their drawing
+     *  (see GCanvasOptions) need this before the pixels are read; for the rest it does nothing.
+     */
+    virtual void flush() {}
+
     // Helpers
 
     void translate(float x, float y) {
@@ -153,6 +167,41 @@ public:
  */
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& bitmap);
 
+/**
+ *  With threads > 1 the canvas records its draws, bins them into tileSize x tileSize tiles of
+ *  the device, and rasterizes the tiles in parallel (draws keep their order within each tile).
+ *  The pixels are identical for any thread count, but they only land in the bitmap on flush(),
+ *  on a draw whose shader can't be kept for later (see GShader::Context::canOutliveShader), or
+ *  when the canvas is deleted. Shaders only need to outlive the draw call they are used in.
+ */
+struct GCanvasOptions {
+    GCanvasOptions(int threads = 1, int tileSize = 64) : threads(threads), tileSize(tileSize) {}
+
+    int threads;
+    int tileSize;
+};
+
+std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& bitmap, const GCanvasOptions& options);
+
+/**
+ *  How the draws since the last GResetDrawCounters() were shaded, over every canvas, for
+ *  benchmarks to report: with just the paint's color, with a shader's context a row at a time,
+ *  or with a pipeline of shader stages (see GShader::appendStages) on 8 bit (lowp) or float
+ *  (highp) colors. Draws that can't change any pixels aren't counted. Also how many mesh
+ *  vertices were mapped through the CTM (each one once per drawMesh, however many triangles
+ *  share it).
+ */
+struct GDrawCounters {
+    uint64_t solid;
+    uint64_t context;
+    uint64_t lowp;
+    uint64_t highp;
+    uint64_t vertexTransforms;
+};
+
+GDrawCounters GGetDrawCounters();
+void GResetDrawCounters();
+
 /**
  *  Implement this, drawing into the provided canvas, and returning the title of your artwork.
  */
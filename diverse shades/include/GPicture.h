@@ -0,0 +1,50 @@
+#ifndef GPicture_DEFINED
+#define GPicture_DEFINED
+
+#include "GCanvas.h"
+#include <memory>
+
+/**
+ *  An immutable list of canvas calls, made by a GRecordingCanvas. It can be played back any
+ *  number of times, into any canvas, under any CTM.
+ *
+ *  The paints are copied, but not their shaders: a shader used while recording has to stay
+ *  alive (and unchanged) for as long as the picture is played back.
+ */
+class GPicture {
+public:
+    virtual ~GPicture() {}
+
+    /**
+     *  Make the recorded calls on canvas, on top of its current CTM. The canvas's CTM is the
+     *  same afterwards as it was before.
+     */
+    virtual void playback(GCanvas* canvas) const = 0;
+
+    /**
+     *  How many calls (save/restore/concat and draws) playback() makes, and how many were
+     *  recorded before the picture was optimized.
+     */
+    virtual int opCount() const = 0;
+    virtual int recordedOpCount() const = 0;
+};
+
+/**
+ *  A canvas that draws nothing, it only remembers what it was asked to draw.
+ */
+class GRecordingCanvas : public GCanvas {
+public:
+    /**
+     *  Return everything recorded so far as a picture, and start over with an empty recording
+     *  and an identity CTM. The picture is optimized on the way out: draws that a later opaque
+     *  rect paints over are dropped, save/restore pairs that change nothing are removed, and
+     *  runs of rects with the same paint are played back as one op. A draw is only dropped if it
+     *  sits at least half a unit inside the rect covering it, so that rounding at the rect's
+     *  edges can't leave one of its pixels uncovered.
+     */
+    virtual std::unique_ptr<GPicture> finishRecording() = 0;
+};
+
+std::unique_ptr<GRecordingCanvas> GCreateRecordingCanvas();
+
+#endif
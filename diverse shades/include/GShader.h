@@ -6,12 +6,14 @@
 #define GShader_DEFINED
 
 #include <memory>
+#include <vector>
 #include "GColor.h"
 #include "GPixel.h"
 #include "GPoint.h"
 
 class GBitmap;
 class GMatrix;
+class Pipeline;
 
 /**
  *  GShaders create colors to fill whatever geometry is being drawn to a GCanvas.
@@ -24,28 +26,129 @@ public:
         kMirror,
     };
 
+    /**
+     *  How a bitmap shader samples its bitmap: the nearest pixel, a bilinear blend of the 2x2
+     *  pixels around the sample point, or a bicubic (Mitchell) blend of the 4x4 around it.
+     */
+    enum FilterQuality {
+        kNearest,
+        kBilinear,
+        kBicubic,
+    };
+
+    /**
+     *  What a shader needs to shade one draw: made from the CTM once per draw call (or moved
+     *  to a new one with setCTM), and owned by that draw. The shader itself never changes, so
+     *  any number of canvases (or threads) can draw with it at the same time, each with its
+     *  own context.
+     */
+    class Context {
+    public:
+        virtual ~Context() {}
+
+        /**
+         *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
+         *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
+         *  can hold at least [count] entries.
+         */
+        virtual void shadeRow(int x, int y, int count, GPixel row[]) = 0;
+
+        /**
+         *  Pixels [x, x + count) of the span on row y that starts at start (<= x), exactly as
+         *  shading the whole span would give them, for a canvas that only draws part of it.
+         *  This shades it all from start, for contexts that step their color along the row
+         *  (and would round differently partway in); the rest only shade [x, x + count).
+         */
+        virtual void shadeSpan(int start, int x, int y, int count, GPixel row[]) {
+            if (start == x) {
+                shadeRow(x, y, count, row);
+                return;
+            }
+            fSpan.resize(x - start + count);
+            shadeRow(start, y, x - start + count, fSpan.data());
+            for (int i = 0; i < count; i++) {
+                row[i] = fSpan[x - start + i];
+            }
+        }
+
+        /**
+         *  What the canvas may assume about the colors, so it can skip shading most pixels:
+         *  kConstant means every pixel is the same color, kConstantRows that every pixel of a
+         *  row is (the color only depends on y).
+         */
+        enum Kind {
+            kGeneral,
+            kConstant,
+            kConstantRows,
+        };
+        virtual Kind kind() const { return kGeneral; }
+
+        /**
+         *  Makes this the context makeContext(ctm) would have made, in place, so draws that
+         *  change the CTM as they go (each triangle of a mesh) don't allocate a context each
+         *  time. Returns false if it can't, which may leave it changed: the caller then drops
+         *  it and makes a new one.
+         */
+        virtual bool setCTM(const GMatrix& ctm) { return false; }
+
+        /**
+         *  True if the context no longer reads the shader, or the pixels it draws, once
+         *  makeContext has returned. A canvas may then keep it to shade the draw later, after
+         *  the shader is gone (see GCanvasOptions). Such a context's setCTM has to take any
+         *  CTM the shader could make a context for, since there is no shader to ask then.
+         */
+        virtual bool canOutliveShader() const { return false; }
+
+    private:
+        std::vector<GPixel> fSpan;  // shadeSpan's whole span, kept for its capacity
+    };
+
     virtual ~GShader() {}
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
-    virtual bool isOpaque() = 0;
+    virtual bool isOpaque() const = 0;
 
-    // The draw calls in GCanvas must call this with the CTM before any calls to shadeSpan().
-    virtual bool setContext(const GMatrix& ctm) = 0;
+    /**
+     *  The draw calls in GCanvas call this with the CTM before shading anything. Returns null
+     *  if the shader can't draw with this CTM (e.g. it can't be inverted), in which case the
+     *  draw draws nothing. The shader must outlive the context.
+     */
+    virtual std::unique_ptr<Context> makeContext(const GMatrix& ctm) const = 0;
 
     /**
-     *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
-     *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
-     *  can hold at least [count] entries.
+     *  Adds stages to pipeline that leave this shader's colors for the CTM in its color
+     *  registers (see pipeline.h), so a draw can shade and blend in one loop. Returns false
+     *  if the shader has no stages or can't draw with this CTM; it may have added some stages
+     *  by then, so the canvas starts over with makeContext. Stages whose state comes from the
+     *  CTM register with Pipeline::appendUpdate, so drawMesh can move them to each triangle.
+     *  Stages that read the shader once this has returned, or sample a bitmap, have to tell
+     *  the pipeline (Pipeline::keepShader and noteRead), since it may be run later.
      */
-    virtual void shadeRow(int x, int y, int count, GPixel row[]) = 0;
+    virtual bool appendStages(Pipeline* pipeline, const GMatrix& ctm) const { return false; }
 };
 
 /**
- *  Return a subclass of GShader that draws the specified bitmap and a local matrix.
- *  Returns null if the either parameter is invalid.
+ *  Return a subclass of GShader that draws the specified bitmap and a local matrix, sampled
+ *  with the given filter quality. Returns null if the either parameter is invalid.
+ *
+ *  The shader reads the bitmap's pixels when it draws, not when it is made. Filtered draws
+ *  that shrink it read smaller copies of them, which are made again once the pixels change:
+ *  canvases report their own draws, and any other code that writes the pixels of a bitmap
+ *  that is being sampled must call GNotifyPixelsChanged before the next draw.
  */
 std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap&, const GMatrix& localMatrix,
-                                             GShader::TileMode = GShader::kClamp);
+                                             GShader::TileMode = GShader::kClamp,
+                                             GShader::FilterQuality = GShader::kNearest);
+
+/**
+ *  Tell the bitmap shaders that the bitmap's pixels (or any that overlap them) were changed
+ *  by something other than a canvas. Call it after writing them and before the next draw
+ *  that samples them; a draw already underway may still read the old copies. It only does
+ *  anything if some shader has made smaller copies of those pixels, and then the copies of
+ *  every bitmap are made again, as after a canvas draws into sampled pixels. Safe from any
+ *  thread.
+ */
+void GNotifyPixelsChanged(const GBitmap&);
 
 /**
  *  Return a subclass of GShader that draws the specified gradient of [count] colors between
@@ -61,6 +164,44 @@ std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap&, const GMatrix& loca
 std::unique_ptr<GShader> GCreateLinearGradient(GPoint p0, GPoint p1, const GColor[], int count,
                                                GShader::TileMode = GShader::kClamp);
 
+/**
+ *  Return a subclass of GShader that draws a radial gradient of [count] colors: color[0] at the
+ *  center, color[count-1] at the given radius, and the rest evenly spaced between.
+ *
+ *  If count < 1 or radius <= 0, this should return nullptr.
+ */
+std::unique_ptr<GShader> GCreateRadialGradient(GPoint center, float radius, const GColor[], int count,
+                                               GShader::TileMode = GShader::kClamp);
+
+/**
+ *  Return a subclass of GShader that draws a gradient between two circles: color[0] on the
+ *  circle (c0, r0), color[count-1] on (c1, r1), and the circles in between (and beyond, per
+ *  the tile mode) interpolated between them. Where circles overlap, the one closer to the
+ *  (c1, r1) end wins, and pixels on no circle are left transparent.
+ *
+ *  If count < 1, either radius is negative, or the circles are the same, this should return
+ *  nullptr.
+ */
+std::unique_ptr<GShader> GCreateTwoPointConicalGradient(GPoint c0, float r0, GPoint c1, float r1,
+                                                        const GColor[], int count,
+                                                        GShader::TileMode = GShader::kClamp);
+
+/**
+ *  Return a subclass of GShader that draws an angular gradient around center: color[0] at
+ *  startAngle and color[count-1] at endAngle, in radians from the +x axis towards +y (so
+ *  clockwise on the screen). The default is one full turn.
+ *
+ *  If count < 1 or the angles are the same, this should return nullptr.
+ */
+std::unique_ptr<GShader> GCreateSweepGradient(GPoint center, float startAngle, float endAngle,
+                                              const GColor[], int count,
+                                              GShader::TileMode = GShader::kClamp);
+
+static inline std::unique_ptr<GShader>
+GCreateSweepGradient(GPoint center, const GColor colors[], int count) {
+    return GCreateSweepGradient(center, 0, 2 * 3.14159265358979f, colors, count);
+}
+
 static inline std::unique_ptr<GShader>
 GCreateLinearGradient(GPoint p0, GPoint p1,
                       const GColor& c0, const GColor& c1,
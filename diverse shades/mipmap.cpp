@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <tuple>
+
+#include "filterKernels.h"
+#include "mipmap.h"
+#include "spans.h"
+
+/*
+ *  Pyramids are found by the bitmap's pixels (and their layout), and only weakly held here, so
+ *  one goes away with the last context using it. Nothing stops the pixels from being drawn
+ *  into between draws, so whatever writes them (every canvas, for its device) bumps
+ *  gGeneration, and a pyramid built before that is made again by the next Find. Only writers
+ *  whose pixels overlap a cached pyramid bump it, which they look up once per gCacheEpoch
+ *  (moved on whenever a pyramid is added or dropped).
+ */
+typedef std::tuple<const GPixel*, int, int, size_t> MipKey;
+
+static std::mutex gMipMutex;
+static std::map<MipKey, std::weak_ptr<MipPyramid>> gMipCache;
+static std::atomic<size_t> gCacheEpoch(0);
+static std::atomic<uint64_t> gGeneration(0);
+
+/* The bytes from a bitmap's first pixel to just past its last one */
+static void pixelRange(const MipKey& key, const char** begin, const char** end) {
+    const int w = std::get<1>(key);
+    const int h = std::get<2>(key);
+    *begin = reinterpret_cast<const char*>(std::get<0>(key));
+    *end = *begin;
+    if (w > 0 && h > 0) {
+        *end += (h - 1) * std::get<3>(key) + w * sizeof(GPixel);
+    }
+}
+
+/* Whether bitmap's pixels share memory with any cached pyramid's. gMipMutex must be held. */
+static bool overlapsCache(const GBitmap& bitmap) {
+    const char* begin;
+    const char* end;
+    pixelRange(MipKey(bitmap.pixels(), bitmap.width(), bitmap.height(), bitmap.rowBytes()), &begin, &end);
+    for (const auto& entry : gMipCache) {
+        const char* cachedBegin;
+        const char* cachedEnd;
+        pixelRange(entry.first, &cachedBegin, &cachedEnd);
+        if (cachedBegin < end && begin < cachedEnd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<MipPyramid> MipPyramid::Find(const GBitmap& bitmap) {
+    const MipKey key(bitmap.pixels(), bitmap.width(), bitmap.height(), bitmap.rowBytes());
+
+    std::lock_guard<std::mutex> lock(gMipMutex);
+    std::shared_ptr<MipPyramid> mips = gMipCache[key].lock();
+    if (!mips || mips->fGeneration.load(std::memory_order_relaxed) != gGeneration.load(std::memory_order_acquire)) {
+        /* drop whatever has died since, so the cache doesn't keep growing */
+        for (auto it = gMipCache.begin(); it != gMipCache.end();) {
+            it = it->second.expired() ? gMipCache.erase(it) : std::next(it);
+        }
+        mips = std::make_shared<MipPyramid>(bitmap);
+        gMipCache[key] = mips;
+        gCacheEpoch.fetch_add(1, std::memory_order_release);
+    }
+    return mips;
+}
+
+void MipPyramid::PixelsChanged(const GBitmap& bitmap) {
+    std::lock_guard<std::mutex> lock(gMipMutex);
+    if (overlapsCache(bitmap)) {
+        gGeneration.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void MipPyramid::Writer::pixelsChanged() {
+    const size_t epoch = gCacheEpoch.load(std::memory_order_acquire);
+    if (epoch != fCacheEpoch) {
+        std::lock_guard<std::mutex> lock(gMipMutex);
+        fOverlaps = overlapsCache(fBitmap);
+        fCacheEpoch = gCacheEpoch.load(std::memory_order_relaxed);
+    }
+    if (fOverlaps) {
+        gGeneration.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void GNotifyPixelsChanged(const GBitmap& bitmap) {
+    MipPyramid::PixelsChanged(bitmap);
+}
+
+MipPyramid::MipPyramid(const GBitmap& bitmap)
+    : fBase(bitmap), fLevelCount(1), fGeneration(gGeneration.load(std::memory_order_acquire)) {
+    int w = bitmap.width();
+    int h = bitmap.height();
+    while (w > 1 || h > 1) {
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+        fLevelCount++;
+    }
+}
+
+GBitmap MipPyramid::level(int i) {
+    i = std::max(0, std::min(i, fLevelCount - 1));
+    if (i == 0) {
+        return fBase;
+    }
+
+    std::lock_guard<std::mutex> lock(fMutex);
+    /* levels built from older pixels start over, keeping theirs for contexts still sampling them */
+    const uint64_t generation = gGeneration.load(std::memory_order_acquire);
+    if (fGeneration.load(std::memory_order_relaxed) != generation) {
+        fLevels.clear();
+        fGeneration.store(generation, std::memory_order_relaxed);
+    }
+    const downsampleProc downsample = getSpanProcs().downsample;
+    while ((int)fLevels.size() < i) {
+        const GBitmap src = fLevels.empty() ? fBase : fLevels.back();
+        const int w = std::max(1, src.width() / 2);
+        const int h = std::max(1, src.height() / 2);
+
+        /* only opaque once it is filled in (GBitmap checks) */
+        std::unique_ptr<GPixel[]> pixels(new GPixel[(size_t)w * h]);
+        GBitmap dst(w, h, w * sizeof(GPixel), pixels.get(), false);
+        for (int y = 0; y < h; y++) {
+            /* an odd row or column at the end is dropped, a single one is used twice */
+            const GPixel* row0 = src.getAddr(0, 2 * y);
+            const GPixel* row1 = src.getAddr(0, std::min(2 * y + 1, src.height() - 1));
+            GPixel* out = dst.getAddr(0, y);
+            if (src.width() > 1) {
+                downsample(row0, row1, out, w);
+            }
+            else {
+                out[0] = average2x2(row0[0], row0[0], row1[0], row1[0]);
+            }
+        }
+        fLevels.push_back(GBitmap(w, h, dst.rowBytes(), dst.pixels(), src.isOpaque()));
+        fPixels.push_back(std::move(pixels));
+    }
+    return fLevels[i - 1];
+}
@@ -0,0 +1,72 @@
+#ifndef mipmap_DEFINED
+#define mipmap_DEFINED
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "GBitmap.h"
+#include "GPixel.h"
+
+/*
+ *  Successively halved copies of one bitmap, for sampling it when it is drawn much smaller than
+ *  it is. Level 0 is the bitmap itself (not copied), and each level after it is half the size
+ *  of the one before (rounded down, at least 1), each pixel the average of a 2x2 block. So all
+ *  the levels together take at most a third of the bitmap's own memory.
+ *
+ *  Levels are only built when they are first asked for. Every context of the same pixels shares
+ *  one pyramid, for as long as any of them holds on to it, or until those pixels change.
+ *
+ *  Changes are counted by one global generation, which each pyramid was built at. Writers bump
+ *  it (only while their pixels overlap some pyramid's), and Find and level start over from the
+ *  pixels when it has moved on, so drawing never has to lock or walk the cache.
+ */
+class MipPyramid {
+public:
+    /* The pyramid for bitmap's pixels, made (empty) on first use */
+    static std::shared_ptr<MipPyramid> Find(const GBitmap& bitmap);
+
+    /*
+     *  Tells the pyramids that bitmap's pixels changed, if they share memory with any of theirs,
+     *  so the next Find starts over from what they hold now. Pyramids already found keep the
+     *  levels they have built. Writer does the same for a canvas, for every draw.
+     */
+    static void PixelsChanged(const GBitmap& bitmap);
+
+    /*
+     *  What a canvas reports its draws into bitmap's pixels through. Whether they overlap a
+     *  pyramid is only looked up again once the cache has changed, so each draw is one atomic
+     *  load, and one atomic add when they do.
+     */
+    class Writer {
+    public:
+        explicit Writer(const GBitmap& bitmap) : fBitmap(bitmap) {}
+
+        void pixelsChanged();
+
+    private:
+        const GBitmap fBitmap;
+        size_t fCacheEpoch = ~size_t(0);    // the cache fOverlaps was looked up in
+        bool fOverlaps = false;
+    };
+
+    /* Levels down to 1x1, counting level 0 */
+    int levelCount() const { return fLevelCount; }
+
+    /* Level i (clamped to the last one), building it first if need be. Safe from any thread. */
+    GBitmap level(int i);
+
+    explicit MipPyramid(const GBitmap& bitmap);
+
+private:
+    const GBitmap fBase;
+    int fLevelCount;
+    std::atomic<uint64_t> fGeneration;              // when fBase held what fLevels were built from
+
+    std::mutex fMutex;
+    std::vector<GBitmap> fLevels;                   // the levels built so far, from 1 on
+    std::vector<std::unique_ptr<GPixel[]>> fPixels; // their pixels, and the dropped levels'
+};
+
+#endif
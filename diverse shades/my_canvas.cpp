@@ -1,7 +1,11 @@
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <stack>
+#include <string.h>
 
 #include "GCanvas.h"
 #include "GRect.h"
@@ -16,10 +20,17 @@
 #include "GPath.h"
 
 #include "blendModes.h"
+#include "blitter.h"
+#include "drawCommand.h"
 #include "edges.h"
+#include "mipmap.h"
 #include "my_composeShader.h"
 #include "my_proxyShader.h"
 #include "my_triShader.h"
+#include "quadLattice.h"
+#include "spans.h"
+#include "threadPool.h"
+#include "triangle.h"
 
 
 int floatToPixel(float value) {
@@ -34,7 +45,38 @@ GPixel colorToPixel(const GColor& c) {
     return GPixel_PackARGB(a, r, g, b);
 }
 
-std::vector<Edge> clip(GPoint left, GPoint right, GRect canvas) {
+/* See GDrawCounters. Only read once the draws are done, so they don't need any ordering. */
+static std::atomic<uint64_t> gSolidDraws;
+static std::atomic<uint64_t> gContextDraws;
+static std::atomic<uint64_t> gLowpDraws;
+static std::atomic<uint64_t> gHighpDraws;
+static std::atomic<uint64_t> gVertexTransforms;
+
+static void count(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+GDrawCounters GGetDrawCounters() {
+    return { gSolidDraws.load(std::memory_order_relaxed), gContextDraws.load(std::memory_order_relaxed),
+             gLowpDraws.load(std::memory_order_relaxed), gHighpDraws.load(std::memory_order_relaxed),
+             gVertexTransforms.load(std::memory_order_relaxed) };
+}
+
+void GResetDrawCounters() {
+    gSolidDraws.store(0, std::memory_order_relaxed);
+    gContextDraws.store(0, std::memory_order_relaxed);
+    gLowpDraws.store(0, std::memory_order_relaxed);
+    gHighpDraws.store(0, std::memory_order_relaxed);
+    gVertexTransforms.store(0, std::memory_order_relaxed);
+}
+
+/* One blitH call, kept by my_tiledCanvas to replay into the tiles it covers */
+struct Span {
+    int x, y, width;
+};
+
+/* Clips the segment to the canvas and appends the resulting edges (if any) to edges. */
+void clip(GPoint left, GPoint right, GRect canvas, std::vector<Edge>& edges) {
     bool w;
     if (left.y() > right.y()) {
         std::swap(left, right);
@@ -44,11 +86,9 @@ std::vector<Edge> clip(GPoint left, GPoint right, GRect canvas) {
         w = true;
     }
 
-    std::vector<Edge> edges;
-
     /* if all edges are out of bounds/unreachable cause pixel center */
     if (right.y() <= canvas.top() || left.y() >= canvas.bottom()) {
-        return edges;
+        return;
     }
 
     /* clip top */
@@ -78,10 +118,9 @@ std::vector<Edge> clip(GPoint left, GPoint right, GRect canvas) {
         left.fX = canvas.left();
         right.fX = canvas.left();
         if (GRoundToInt(p0.y()) != GRoundToInt(p1.y())) {
-            Edge* e = createEdge(p0, p1, w);
-            edges.push_back(*e);
+            edges.push_back(createEdge(p0, p1, w));
         }
-        return edges;
+        return;
     }
 
     if (left.x() >= canvas.right()) {
@@ -91,10 +130,9 @@ std::vector<Edge> clip(GPoint left, GPoint right, GRect canvas) {
         left.fX = canvas.right();
         right.fX = canvas.right();
         if (GRoundToInt(p0.y()) != GRoundToInt(p1.y())) {
-            Edge* e = createEdge(p0, p1, w);
-            edges.push_back(*e);
+            edges.push_back(createEdge(p0, p1, w));
         }
-        return edges;
+        return;
     }
 
     if (left.x() < canvas.left()) {
@@ -104,8 +142,7 @@ std::vector<Edge> clip(GPoint left, GPoint right, GRect canvas) {
         left.fX = canvas.left();
         left.fY = newY;
         if (GRoundToInt(p1.y()) != GRoundToInt(p0.y())) {
-            Edge* e = createEdge(p0, p1, w);
-            edges.push_back(*e);
+            edges.push_back(createEdge(p0, p1, w));
         }
 
     }
@@ -117,24 +154,61 @@ std::vector<Edge> clip(GPoint left, GPoint right, GRect canvas) {
         right.fX = canvas.right();
         right.fY = newY;
         if (GRoundToInt(p1.y()) != GRoundToInt(p0.y())) {
-            Edge* e = createEdge(p1, p0, w);
-            edges.push_back(*e);
+            edges.push_back(createEdge(p1, p0, w));
         }
     }
 
     if (GRoundToInt(left.y()) != GRoundToInt(right.y())) {
-        Edge* e = createEdge(left, right, w);
-        edges.push_back(*e);
+        edges.push_back(createEdge(left, right, w));
     }
-    return edges;
 }
 
 
 class my_canvas : public GCanvas {
 public:
-    my_canvas(const GBitmap& device) : fDevice(device) {
+    my_canvas(const GBitmap& device) : fDevice(device), fWrites(device), fSpans(getSpanProcs()) {
         matrix = GMatrix();
         stack.push(matrix);
+        fClip = GIRect::WH(device.width(), device.height());
+    }
+
+    /* Used by my_tiledCanvas to replay a recorded draw into just one of its tiles */
+    void setCTM(const GMatrix& ctm) {
+        matrix = ctm;
+    }
+
+    void setClip(const GIRect& clip) {
+        fClip = clip;
+    }
+
+    /* my_tiledCanvas reports its writes to the mip cache once per flush instead of per tile */
+    void setReportsWrites(bool reportsWrites) {
+        fReportsWrites = reportsWrites;
+    }
+
+    /*
+     *  my_tiledCanvas made this draw's shading when it recorded it, the shader's context or its
+     *  stages, so draws use that instead of the paint's shader
+     */
+    void setRecordedShading(GShader::Context* context, Pipeline* pipeline, bool shadedOpaque) {
+        fRecordedContext = context;
+        fRecordedPipeline = pipeline;
+        fRecordedOpaque = shadedOpaque;
+    }
+
+    /*
+     *  A textured mesh's shading as drawMeshTriangles sets it up, made for ctm, for
+     *  my_tiledCanvas to record: stages in pipeline (reading this canvas's triangle colors), or
+     *  a context. The draw moves it to each triangle. False if the shader can't draw with ctm.
+     */
+    bool recordMeshShading(bool colors, const GShader& shader, const GMatrix& ctm, Pipeline* pipeline,
+                           std::unique_ptr<GShader::Context>* context) {
+        pipeline->reset();
+        if (!appendMeshStages(pipeline, colors, &shader, ctm, context)) {
+            pipeline->reset();
+            return false;
+        }
+        return true;
     }
 
     /**
@@ -182,27 +256,31 @@ public:
     *  rectangles.
     */
     void drawConvexPolygon(const GPoint points[], int count, const GPaint& paint) {
-        GShader* shader = paint.getShader();
-        if (shader != nullptr) {
-            if (!(shader->setContext(matrix))) {
-                return;
-            }
+        std::unique_ptr<GShader::Context> context;
+        if (!setShader(paint, &context)) {
+            return;
         }
         if (count < 0) {
             return;
         }
+        GBlitter* blitter = chooseBlitter(paint, context.get());
+        if (blitter == nullptr) {
+            return;
+        }
 
-        GRect canvas = GRect::WH(fDevice.width(), fDevice.height());
         GPoint dstPoints[count];
         matrix.mapPoints(dstPoints, points, count);
-        std::vector<Edge> edges;
+        scanConvex(dstPoints, count, blitter);
+    }
 
-        for (int i = 0; i < count; i++) {
-            std::vector<Edge> edgesAdd = clip(dstPoints[i], dstPoints[(i + 1) % count], canvas);
-            for (int j = 0; j < edgesAdd.size(); j++) {
-                edges.push_back(edgesAdd.at(j));
-            }
+    /* Fills the convex polygon dstPoints (device space) with blitter */
+    void scanConvex(const GPoint dstPoints[], int count, GBlitter* blitter) {
+        GRect canvas = GRect::WH(fDevice.width(), fDevice.height());
+        std::vector<Edge>& edges = fEdges;
+        edges.clear();
 
+        for (int i = 0; i < count; i++) {
+            clip(dstPoints[i], dstPoints[(i + 1) % count], canvas, edges);
         }
 
         if (edges.size() == 0) {
@@ -235,7 +313,7 @@ public:
        // assert(count1 == 2);
        // assert(count2 == 2);
 
-        while (min < max) {
+        while (min < max && min < fClip.fBottom) {
             if (left.bottom <= min) {
                 left = edges.at(index);
                 index++;
@@ -245,7 +323,11 @@ public:
                 index++;
             }
 
-            paintRow(min, GRoundToInt(left.currX), GRoundToInt(right.currX), paint);
+            /* rows above the clip (a tile's) only step the edges */
+            if (min >= fClip.fTop) {
+                int x0 = GRoundToInt(left.currX);
+                blitter->blitH(x0, min, GRoundToInt(right.currX) - x0);
+            }
             left.currX += left.m;
             right.currX += right.m;
             min++;
@@ -253,6 +335,10 @@ public:
     }
 
     void drawRect(const GRect& rect, const GPaint& paint) override {
+        if (matrix[GMatrix::KX] == 0 && matrix[GMatrix::KY] == 0 && drawAlignedRect(rect, paint)) {
+            return;
+        }
+
         GPoint p0 = GPoint();
         p0.fX = rect.fLeft;
         p0.fY = rect.fTop;
@@ -270,108 +356,142 @@ public:
         drawConvexPolygon(points, 4, paint);
     }
 
+    /*
+     *  Under a scale + translate CTM a rect is still a rect, and its two vertical edges would
+     *  just cover [round(left), round(right)) on rows [round(top), round(bottom)), after being
+     *  clamped to the canvas, so the whole rect goes to the blitter in one call. Returns false
+     *  (draws nothing) if the mapped rect isn't finite, leaving it to drawConvexPolygon.
+     */
+    bool drawAlignedRect(const GRect& rect, const GPaint& paint) {
+        GPoint pts[2] = { { rect.fLeft, rect.fTop }, { rect.fRight, rect.fBottom } };
+        matrix.mapPoints(pts, pts, 2);
+        if (!std::isfinite(pts[0].fX) || !std::isfinite(pts[0].fY) ||
+            !std::isfinite(pts[1].fX) || !std::isfinite(pts[1].fY)) {
+            return false;
+        }
+
+        std::unique_ptr<GShader::Context> context;
+        if (!setShader(paint, &context)) {
+            return true;
+        }
+        GBlitter* blitter = chooseBlitter(paint, context.get());
+        if (blitter == nullptr) {
+            return true;
+        }
+
+        const float w = fDevice.width();
+        const float h = fDevice.height();
+        int left = GRoundToInt(std::min(std::max(std::min(pts[0].fX, pts[1].fX), 0.0f), w));
+        int right = GRoundToInt(std::min(std::max(std::max(pts[0].fX, pts[1].fX), 0.0f), w));
+        int top = GRoundToInt(std::max(std::min(pts[0].fY, pts[1].fY), 0.0f));
+        int bottom = GRoundToInt(std::min(std::max(pts[0].fY, pts[1].fY), h));
+        if (left < right && top < bottom) {
+            blitter->blitRect(left, top, right - left, bottom - top);
+        }
+        return true;
+    }
+
     void drawPath(const GPath& path, const GPaint& paint) override {
-        GRect canvas = GRect::WH(fDevice.width(), fDevice.height());
-        GPath gpath = path;
-        GShader* shader = paint.getShader();
-        if (shader != nullptr) {
-            if (!(shader->setContext(matrix))) {
-                return;
-            }
+        std::unique_ptr<GShader::Context> context;
+        if (!setShader(paint, &context)) {
+            return;
         }
-        gpath.transform(matrix);
-        GPath::Edger edger = GPath::Edger(gpath);
-        std::vector<Edge> edges;
-        GPoint nextPts[4];
+        GBlitter* blitter = chooseBlitter(paint, context.get());
+        if (blitter == nullptr) {
+            return;
+        }
+        pathEdges(path, fEdges);
+        if (fEdges.size() == 0) {
+            return;
+        }
+
+        complexScan(fEdges, blitter);
+    }
+
+    /*
+     *  Used by my_tiledCanvas to scan a path once for every tile instead of once per tile:
+     *  drawPath's scan of the whole device into blitter, which keeps the spans for drawSpans.
+     */
+    void scanPath(const GPath& path, GBlitter* blitter) {
+        const GIRect clip = fClip;
+        fClip = GIRect::WH(fDevice.width(), fDevice.height());
+        pathEdges(path, fEdges);
+        if (fEdges.size() > 0) {
+            complexScan(fEdges, blitter);
+        }
+        fClip = clip;
+    }
+
+    /* Blits spans from scanPath with the paint, as drawPath would have */
+    void drawSpans(const Span spans[], int count, const GPaint& paint) {
+        std::unique_ptr<GShader::Context> context;
+        if (!setShader(paint, &context)) {
+            return;
+        }
+        GBlitter* blitter = chooseBlitter(paint, context.get());
+        if (blitter == nullptr) {
+            return;
+        }
+        for (int i = 0; i < count; i++) {
+            blitter->blitH(spans[i].x, spans[i].y, spans[i].width);
+        }
+    }
+
+    /* The path's edges under the CTM, clipped to the device, but none outside the clip's rows */
+    void pathEdges(const GPath& path, std::vector<Edge>& edges) {
+        GRect canvas = GRect::WH(fDevice.width(), fDevice.height());
+        /* map each segment as we go rather than transforming a copy of the path */
+        GPath::Edger edger = GPath::Edger(path);
+        edges.clear();
+        GPoint nextPts[GPath::kMaxNextPoints];
         GPath::Verb nextVerb = edger.next(nextPts);
 
         while (nextVerb != GPath::Verb::kDone) {
             if (nextVerb == GPath::Verb::kLine) {
-                std::vector<Edge> edgesAdd= clip(nextPts[0], nextPts[1], canvas);
-                for (int i = 0; i < edgesAdd.size(); i++) {
-                    edges.push_back(edgesAdd.at(i));
+                matrix.mapPoints(nextPts, 2);
+                if (!outsideClipRows(nextPts, 2)) {
+                    clip(nextPts[0], nextPts[1], canvas, edges);
                 }
             }
             else if(nextVerb == GPath::Verb::kQuad) {
+                matrix.mapPoints(nextPts, 3);
+                if (outsideClipRows(nextPts, 3)) {
+                    nextVerb = edger.next(nextPts);
+                    continue;
+                }
                 int n = numQuadSegments(nextPts);
                 GPoint pt = nextPts[0];
                 for (int i = 1; i < n; i++) {
                     float t = (float)i / n;
                     GPoint pt2 = getQuadPt(nextPts, t);
-                    std::vector<Edge> edgesAdd = clip(pt, pt2, canvas);
-                    for (int j = 0; j < edgesAdd.size(); j++) {
-                        edges.push_back(edgesAdd.at(j));
-                    }
+                    clip(pt, pt2, canvas, edges);
                     pt = pt2;
                 }
-                std::vector<Edge> edgesAdd = clip(pt, nextPts[2], canvas);
-                for (int k = 0; k < edgesAdd.size(); k++) {
-                    edges.push_back(edgesAdd.at(k));
-                }
+                clip(pt, nextPts[2], canvas, edges);
             }
             else if (nextVerb == GPath::Verb::kCubic) {
+                matrix.mapPoints(nextPts, 4);
+                if (outsideClipRows(nextPts, 4)) {
+                    nextVerb = edger.next(nextPts);
+                    continue;
+                }
                 int n = numCubicSegments(nextPts);
                 GPoint pt = nextPts[0];
                 for (int i = 1; i < n; i++) {
                     float t = (float) i / n;
                     GPoint pt2 = getCubicPt(nextPts, t);
-                    std::vector<Edge> edgesAdd = clip(pt, pt2, canvas);
-                    for (int j = 0; j < edgesAdd.size(); j++) {
-                        edges.push_back(edgesAdd.at(j));
-                    }
+                    clip(pt, pt2, canvas, edges);
                     pt = pt2;
                 }
-                std::vector<Edge> edgesAdd = clip(pt, nextPts[3], canvas);
-                for (int k = 0; k < edgesAdd.size(); k++) {
-                    edges.push_back(edgesAdd.at(k));
-                }
+                clip(pt, nextPts[3], canvas, edges);
             }
             else {
             }
             nextVerb = edger.next(nextPts); //increment
             
         }
-        if (edges.size() == 0) {
-            return;
-        }
-
-        std::sort(edges.begin(), edges.end(), lessThan);
-
-        complexScan(edges, paint);
-    }
-
-    void drawTriangle(const GPoint pts[3], const GColor colors[], const GPoint texs[], const GPaint& paint) {
-        if (colors != nullptr && texs != nullptr) {
-            GPaint pnt(new my_compositeShader(new my_triShader(pts, colors), paint.getShader()));
-            drawConvexPolygon(pts, 3, pnt);
-        }
-        else if (colors != nullptr) {
-            GPaint pnt(new my_triShader(pts, colors));
-            drawConvexPolygon(pts, 3, pnt);
-        }
-        else {
-            drawConvexPolygon(pts, 3, paint);
-        }
     }
 
-    void drawTextTriangle(const GPoint pts[3], const GColor colors[], const GPoint texs[], GShader* ogshader) {
-        GMatrix P;
-        GMatrix T;
-        GMatrix invertedT;
-
-        P = GMatrix(pts[1].x() - pts[0].x(), pts[2].x() - pts[0].x(), pts[0].x(), pts[1].y() - pts[0].y(), pts[2].y() - pts[0].y(), pts[0].y());
-        T = GMatrix(texs[1].x() - texs[0].x(), texs[2].x() - texs[0].x(), texs[0].x(), texs[1].y() - texs[0].y(), texs[2].y() - texs[0].y(), texs[0].y());
-
-        if (T.invert(&invertedT) == false) {
-            return;
-            //do nothing
-        }
-        my_proxyShader prox = my_proxyShader(ogshader, P * invertedT);
-        GPaint pnt(&prox);
-        drawTriangle(pts, colors, texs, pnt);
-    }
-
-
 /**
  *  Draw a mesh of triangles, with optional colors and/or texture-coordinates at each vertex.
  *
@@ -402,27 +522,115 @@ public:
  *  together, component by component.
  */
     void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[], int count, const int indices[], const GPaint& paint) {
-        int num = 0;
+        mapVertices(verts, count, indices);
+        drawMeshTriangles(verts, fMeshDevice.data(), colors, texs, indices, nullptr, count, paint);
+    }
+
+    /*
+     *  drawMesh with every vertex already mapped through the CTM into device, for count of its
+     *  triangles: the ones numbered in triangles (by where they are in indices), in that order,
+     *  or the first count when that is null. my_tiledCanvas draws each tile's share of a mesh
+     *  with this.
+     */
+    void drawMeshTriangles(const GPoint verts[], const GPoint device[], const GColor colors[], const GPoint texs[],
+                           const int indices[], const int triangles[], int count, const GPaint& paint) {
+        GShader* shader = texs != nullptr ? paint.getShader() : nullptr;
+        /* my_tiledCanvas takes the shader out of the paint when it records its shading */
+        const bool recorded = fRecordedContext != nullptr || fRecordedPipeline != nullptr;
+        const bool textured = shader != nullptr || (texs != nullptr && recorded);
+        if (colors == nullptr && !textured) {
+            /* just the paint, set up once for every triangle */
+            std::unique_ptr<GShader::Context> context;
+            if (!setShader(paint, &context)) {
+                return;
+            }
+            GBlitter* blitter = chooseBlitter(paint, context.get());
+            if (blitter == nullptr) {
+                return;
+            }
+            for (int i = 0; i < count; i++) {
+                if (setTriangle(device, &indices[3 * (triangles ? triangles[i] : i)])) {
+                    blitTriangle(blitter);
+                }
+            }
+            return;
+        }
+
+        /* every pixel is opaque if every color is, times the shader's */
+        bool opaque = !textured || (recorded ? fRecordedOpaque : shader->isOpaque());
+        for (int i = 0; colors != nullptr && opaque && i < count; i++) {
+            const int* index = &indices[3 * (triangles ? triangles[i] : i)];
+            opaque = colors[index[0]].a == 1.0 && colors[index[1]].a == 1.0 && colors[index[2]].a == 1.0;
+        }
+
+        /*
+         *  The pipeline is built for the first triangle that can be drawn at all, then moved to
+         *  each one after it in place: fMeshColors is set to the triangle's colors, and the
+         *  shader's stages are updated to the CTM that maps its texs to its verts. A shader
+         *  with no stages that is drawn on its own makes a context for each triangle instead,
+         *  to keep ShaderBlitter's shortcuts. Recorded shading was built before the draw, and
+         *  is only moved.
+         */
+        fPipeline.reset();
+        std::unique_ptr<GShader::Context> context;
+        GBlitter* blitter = nullptr;
         for (int i = 0; i < count; i++) {
-            const GPoint pts[3] = { verts[indices[num + 0]], verts[indices[num + 1]], verts[indices[num + 2]] };
+            const int* index = &indices[3 * (triangles ? triangles[i] : i)];
+            if (!setTriangle(device, index)) {
+                continue;
+            }
+            const GPoint pts[3] = { verts[index[0]], verts[index[1]], verts[index[2]] };
+            if (colors != nullptr) {
+                const GColor color[3] = { colors[index[0]], colors[index[1]], colors[index[2]] };
+                if (!fMeshColors.set(pts, color, matrix)) {
+                    continue;
+                }
+            }
+            GMatrix texCTM;
+            if (textured) {
+                const GPoint tex[3] = { texs[index[0]], texs[index[1]], texs[index[2]] };
+                if (!textureCTM(pts, tex, &texCTM)) {
+                    continue;
+                }
+            }
 
-            if (colors != nullptr && texs != nullptr) {
-                const GColor color[3] = { colors[indices[num + 0]], colors[indices[num + 1]], colors[indices[num + 2]] };
-                const GPoint texture[3] = { texs[indices[num + 0]], texs[indices[num + 1]], texs[indices[num + 2]] };
-                drawTextTriangle(pts, color, texture, paint.getShader());
+            if (recorded) {
+                const bool moved = fRecordedContext != nullptr ? fRecordedContext->setCTM(texCTM)
+                                                               : fRecordedPipeline->update(texCTM);
+                if (!moved) {
+                    continue;
+                }
+                if (blitter == nullptr) {
+                    blitter = chooseBlitter(GPaint(), fRecordedContext, opaque);
+                }
+                else if (fRecordedContext != nullptr) {
+                    blitter = setBlitter(GPaint(), fRecordedContext, opaque);
+                }
+            }
+            else if (blitter == nullptr) {
+                if (!appendMeshStages(&fPipeline, colors != nullptr, shader, texCTM, &context)) {
+                    fPipeline.reset();
+                    continue;
+                }
+                /* colors and texs are drawn like a paint of their own, with the default mode */
+                blitter = chooseBlitter(GPaint(), context.get(), opaque);
             }
-            else if (colors != nullptr) {
-                const GColor color[3] = { colors[indices[num + 0]], colors[indices[num + 1]], colors[indices[num + 2]] };
-                drawTriangle(pts, color, nullptr, paint);
+            else if (fPipeline.empty()) {
+                if (context == nullptr || !context->setCTM(texCTM)) {
+                    context = shader->makeContext(texCTM);
+                    if (context == nullptr) {
+                        continue;
+                    }
+                }
+                blitter = setBlitter(GPaint(), context.get(), opaque);
             }
-            else if (texs != nullptr) {
-                const GPoint texture[3] = { texs[indices[num + 0]], texs[indices[num + 1]], texs[indices[num + 2]] };
-                drawTextTriangle(pts, nullptr, texture, paint.getShader());
+            else if (shader != nullptr && !fPipeline.update(texCTM)) {
+                continue;
             }
-            else {
-                drawTriangle(pts, nullptr, nullptr, paint);                
+            if (blitter == nullptr) {
+                return;
             }
-            num += 3;
+            blitTriangle(blitter);
         }
     }
 
@@ -448,242 +656,344 @@ public:
         if (colors == nullptr && texs == nullptr) {
             return;
         }
-        int quadNum = (int)pow(level + 1, 2);
-        int triNum = quadNum * 2;
-        int cornerNum = (int)pow(level + 2, 2);
-        GPoint corners[cornerNum];
-        GColor color[cornerNum];
-        GPoint texture[cornerNum];
-
-        int x = 0;
-        for (int i = 0; i <= level + 1; i++) {
-            float v = (float) i / (level + 1);
-            for (int j = 0; j <= level + 1; j++) {
-                float u = (float) j / (level + 1);
-                corners[x] = findPoint(verts, u, v);
-                if (colors != nullptr) {
-                    color[x] = findColor(colors, u, v);
-                }
-                if (texs != nullptr) {
-                    texture[x] = findPoint(texs, u, v);
-                }
-                x++;
-            }
+        if (level < 0) {
+            level = QuadLattice::AutoLevel(matrix, verts, colors, texs);
         }
+        fQuad.set(verts, colors, texs, level);
+        drawMesh(fQuad.verts(), fQuad.colors(), fQuad.texs(), fQuad.triangles(), fQuad.indices(), paint);
+    }
 
-        int indices[quadNum * 6];
-        int b = 0;
-        int c = 0;
-
-        for (int a = 0; a <= level; a++) {
-            indices[b] = c;
-            indices[b + 1] = c + 1;
-            indices[b + 2] = c + level + 2;
-
-            c += 1;
-            b += 3;
-
-            for (int d = 0; d < level; d++) {
-                indices[b] = c;
-                indices[b + 1] = c + level + 2;
-                indices[b + 2] = c + level + 1;
-
-                indices[b + 3] = c;
-                indices[b + 4] = c + 1;
-                indices[b + 5] = c + level + 2;
-
-                c += 1; 
-                b += 6;
-            }
-
-            indices[b] = c;
-            indices[b + 1] = c + 2 + level;
-            indices[b + 2] = c + level + 1;
+private:
+    // Note: we store a copy of the bitmap
+    const GBitmap fDevice;
+    MipPyramid::Writer fWrites;     // our draws, for pyramids of the device's pixels
 
-            b += 3;
-            c += 1;
+    std::stack<GMatrix> stack;
+    GMatrix matrix; // identity matrix
 
+    // row and solid span procs for every blend mode, for this CPU
+    const SpanProcs& fSpans;
+
+    // pixels outside of this are never touched (the whole device unless we are a tile)
+    GIRect fClip;
+    bool fReportsWrites = true;
+    GShader::Context* fRecordedContext = nullptr;   // see setRecordedShading
+    Pipeline* fRecordedPipeline = nullptr;
+    bool fRecordedOpaque = false;
+
+    /* Scratch storage reused by every draw. It is cleared, never freed, so once the canvas has
+       seen its largest path the edge building and scanning no longer touch the heap. */
+    std::vector<Edge> fEdges;
+    std::vector<Edge> fPending;
+    std::vector<Edge*> fActive;
+    std::vector<int> fBucket;
+
+    // drawMesh's vertices in device space, and its state for the triangle it's drawing, reset
+    // in place for each one
+    std::vector<GPoint> fMeshDevice;
+    TriangleRaster fTriangle;
+    GPoint fTriangleDevice[3];
+    bool fTriangleFits;
+    TriColors fMeshColors;
+
+    // drawQuad's triangles, kept for each level it has drawn
+    QuadLattice fQuad;
+
+    // chooseBlitter sets up one of these for each draw
+    SolidBlitter fSolidBlitter;
+    ShaderBlitter fShaderBlitter;
+    PipelineBlitter fPipelineBlitter;
+
+    /* the stages of this draw's shader, when it has them (see setShader) */
+    Pipeline fPipeline;
+
+    /*
+     *  Gets the paint's shader ready for one draw: its stages in fPipeline if it has them,
+     *  otherwise its context. Returns false if the shader can't draw with the CTM at all.
+     */
+    bool setShader(const GPaint& paint, std::unique_ptr<GShader::Context>* context) {
+        fPipeline.reset();
+        GShader* shader = paint.getShader();
+        if (shader == nullptr) {
+            return true;
+        }
+        if (shader->appendStages(&fPipeline, matrix)) {
+            return true;
         }
+        fPipeline.reset();
+        *context = shader->makeContext(matrix);
+        return *context != nullptr;
+    }
 
-        if (texs == nullptr && colors == nullptr) {
-            drawMesh(corners, nullptr, nullptr, triNum, indices, paint);
+    /*
+     *  A mesh's shading into pipeline: its colors (from fMeshColors) times the shader's, the
+     *  shader mapped by texCTM. A shader on its own without stages goes in context instead.
+     *  Returns false if the shader can't draw with texCTM.
+     */
+    bool appendMeshStages(Pipeline* pipeline, bool colors, const GShader* shader, const GMatrix& texCTM,
+                          std::unique_ptr<GShader::Context>* context) {
+        if (colors) {
+            pipeline->append(TriColors::Stage, &fMeshColors, Pipeline::kHighp);
+            pipeline->appendPack();
         }
-        else if (texs == nullptr) {
-            drawMesh(corners, color, nullptr, triNum, indices, paint);
+        if (shader == nullptr) {
+            return true;
         }
-        else if (colors == nullptr) {
-            drawMesh(corners, nullptr, texture, triNum, indices, paint);
+        if (colors) {
+            pipeline->appendSave();
         }
-        else {
-            drawMesh(corners, color, texture, triNum, indices, paint);
+        if (!shader->appendStages(pipeline, texCTM)) {
+            if (!colors) {
+                pipeline->reset();
+                *context = shader->makeContext(texCTM);
+                return *context != nullptr;
+            }
+            if (!pipeline->appendContext(*shader, texCTM)) {
+                return false;
+            }
         }
-
+        if (colors) {
+            pipeline->appendModulate();
+        }
+        return true;
     }
 
-private:
-    // Note: we store a copy of the bitmap
-    const GBitmap fDevice;
-
-    std::stack<GMatrix> stack;
-    GMatrix matrix; // identity matrix
+    /* The stages this draw shades with: the recorded ones, or what setShader put in fPipeline */
+    Pipeline& pipeline() {
+        return fRecordedPipeline != nullptr ? *fRecordedPipeline : fPipeline;
+    }
 
-    void paintRow(int y, int leftX, int rightX, const GPaint& paint) {
-        leftX = std::max(0, leftX);
-        rightX = std::min(fDevice.width(), rightX);
-        GPixel src = colorToPixel(paint.getColor().pinToUnit());
+    /* The CTM for a mesh's shader that puts its texs on the triangle pts, false if texs have no area */
+    bool textureCTM(const GPoint pts[3], const GPoint texs[3], GMatrix* ctm) const {
+        GMatrix P = GMatrix(pts[1].x() - pts[0].x(), pts[2].x() - pts[0].x(), pts[0].x(), pts[1].y() - pts[0].y(), pts[2].y() - pts[0].y(), pts[0].y());
+        GMatrix T = GMatrix(texs[1].x() - texs[0].x(), texs[2].x() - texs[0].x(), texs[0].x(), texs[1].y() - texs[0].y(), texs[2].y() - texs[0].y(), texs[0].y());
+        GMatrix invertedT;
+        if (!T.invert(&invertedT)) {
+            return false;
+        }
+        *ctm = matrix * (P * invertedT);
+        return true;
+    }
 
-        blendProc blender = getProc(paint.getBlendMode(), src);
-        bool srcover = (blender == kSrcOver);
+    /*
+     *  Maps every vertex the mesh's indices use through the CTM into fMeshDevice, once, so
+     *  the triangles that share a vertex share its mapped point as well.
+     */
+    void mapVertices(const GPoint verts[], int triangles, const int indices[]) {
+        int last = -1;
+        for (int i = 0; i < 3 * triangles; i++) {
+            last = std::max(last, indices[i]);
+        }
+        fMeshDevice.resize(last + 1);
+        matrix.mapPoints(fMeshDevice.data(), verts, last + 1);
+        count(gVertexTransforms, last + 1);
+    }
 
-        if (blender == kDst) {
-            return;
+    /* Sets up the mesh triangle with these vertices, false if it can't cover any pixel in the clip */
+    bool setTriangle(const GPoint device[], const int index[3]) {
+        for (int i = 0; i < 3; i++) {
+            fTriangleDevice[i] = device[index[i]];
         }
+        fTriangleFits = TriangleRaster::Fits(fTriangleDevice);
+        /* spans still start at the triangle's own left edge, see ShaderBlitter */
+        const GIRect rows = GIRect::LTRB(0, fClip.fTop, fDevice.width(), fClip.fBottom);
+        return !fTriangleFits || fTriangle.set(fTriangleDevice, rows);
+    }
 
-        if (paint.getShader() == nullptr) {
-            if (rightX <= leftX) {
-                return;
-            }
-            GPixel* addr = fDevice.getAddr(leftX, y);
-           // for (int x = leftX; x < rightX; x++) {
-                if (srcover) {
-                    for (int x = leftX; x < rightX; x++) {
-                        *addr = kSrcOver(src, *addr);
-                        *addr++;
-                    }
-                }
-                else if (blender == kSrc) {
-                    for (int x = leftX; x < rightX; x++) {
-                        *addr = kSrc(src, *addr);
-                        *addr++;
-                    }
-                }
-                else {
-                    for (int x = leftX; x < rightX; x++) {
-                        *addr = blender(src, *addr);
-                        *addr++;
-                    }
-                }
-               // *addr++;
-            //}
+    /* Fills the triangle from setTriangle, with the polygon path if it is too far out */
+    void blitTriangle(GBlitter* blitter) {
+        if (fTriangleFits) {
+            fTriangle.blit(blitter);
         }
         else {
-            GShader* shader = paint.getShader();
-            if (!shader->setContext(matrix) || rightX <= leftX) {
-                return;
-            }
-            int count = rightX - leftX;
-            assert(leftX >= 0 && count >= 0);
-            GPixel row[count];
-            shader->shadeRow(leftX, y, count, row);
-
-            GPixel* addr = fDevice.getAddr(leftX, y);
-
-            //for (int x = leftX; x < rightX; x++) {
-                if (srcover) {
-                    for (int x = leftX; x < rightX; x++) {
-                        *addr = kSrcOver(row[x - leftX], *addr);
-                        *addr++;
-                    }
-                    
-                }
-                else if (blender == kSrc) {
-                    for (int x = leftX; x < rightX; x++) {
-                        *addr = kSrc(row[x - leftX], *addr);
-                        *addr++;
-                    }
+            scanConvex(fTriangleDevice, 3, blitter);
+        }
+    }
 
-                }
-                else {
-                    for (int x = leftX; x < rightX; x++) {
-                        *addr = blender(row[x - leftX], *addr);
-                        *addr++;
-                    }
+    /*
+     *  Picks the blitter for one draw and sets it up, or returns null if the draw can't change
+     *  any pixels. context is the paint's shader context for this draw (null without a shader,
+     *  or when setShader put its stages in fPipeline).
+     */
+    GBlitter* chooseBlitter(const GPaint& paint, GShader::Context* context) {
+        if (fRecordedContext != nullptr || fRecordedPipeline != nullptr) {
+            return chooseBlitter(paint, fRecordedContext, fRecordedOpaque);
+        }
+        GShader* shader = paint.getShader();
+        return chooseBlitter(paint, context, shader != nullptr && shader->isOpaque());
+    }
 
-                }
-               // *addr++;
-            //}
+    /* shadedOpaque: whether the shaded pixels are all opaque, when a shader is drawing */
+    GBlitter* chooseBlitter(const GPaint& paint, GShader::Context* context, bool shadedOpaque) {
+        GBlitter* blitter = setBlitter(paint, context, shadedOpaque);
+        if (blitter != nullptr && fReportsWrites) {
+            /* shaders sampling our pixels have to stop using mip levels made from the old ones */
+            fWrites.pixelsChanged();
         }
+        if (blitter == &fPipelineBlitter) {
+            count(pipeline().precision() == Pipeline::kHighp ? gHighpDraws : gLowpDraws);
+        }
+        else if (blitter == &fShaderBlitter) {
+            count(gContextDraws);
+        }
+        else if (blitter != nullptr) {
+            count(gSolidDraws);
+        }
+        return blitter;
     }
 
-    void blit(int x0, int x1, int y, const GPaint& paint) {
-        GShader* shader = paint.getShader();
-        GPixel src = colorToPixel(paint.getColor());
+    /* chooseBlitter without counting a draw, for the triangles of a mesh after its first */
+    GBlitter* setBlitter(const GPaint& paint, GShader::Context* context, bool shadedOpaque) {
+        GPixel src = colorToPixel(paint.getColor().pinToUnit());
+        GBlendMode mode = paint.getBlendMode();
+        if (context != nullptr && context->kind() == GShader::Context::kConstant) {
+            /* one color everywhere is drawn like a paint color */
+            context->shadeRow(0, 0, 1, &src);
+            context = nullptr;
+        }
+        /* shaded pixels are opaque or clear or neither whatever the paint color is */
+        Pipeline& pipeline = this->pipeline();
+        const bool shaded = context != nullptr || !pipeline.empty();
+        if (!shaded) {
+            mode = reduceMode(mode, src);
+        }
+        if (shaded ? shadedOpaque : GPixel_GetA(src) == 0xFF) {
+            mode = reduceModeOpaque(mode);
+        }
+        if (mode == GBlendMode::kDst) {
+            return nullptr;
+        }
+        if (!pipeline.empty()) {
+            pipeline.appendBlend(fSpans.row[static_cast<int>(mode)]);
+            fPipelineBlitter.set(&fDevice, fClip, &pipeline);
+            return &fPipelineBlitter;
+        }
+        if (context != nullptr) {
+            fShaderBlitter.set(&fDevice, fClip, context, mode, fSpans);
+            return &fShaderBlitter;
+        }
+        fSolidBlitter.set(&fDevice, fClip, src, mode, fSpans);
+        return &fSolidBlitter;
+    }
 
-        blendProc blender = getProc(paint.getBlendMode(), src);
-        if (blender == kDst) {
-           return;
+    /**
+     *  Active-edge-table scan converter (non-zero winding).
+     *
+     *  Pending edges are bucketed by their top scanline, so each row only looks at the edges
+     *  that start on it. The active list is kept sorted by currX with an insertion sort, which
+     *  is nearly free since the order barely changes from one row to the next. Edges that run
+     *  out are compacted away in place instead of being erased from the middle of a vector.
+     *
+     *  Rows above the clip (a tile's) are never drawn, so the edges that reach it are stepped
+     *  straight to its top. Ties in currX go to the edge that comes first in pending, so the
+     *  order on a row doesn't depend on the rows before it, and a tile draws the same spans
+     *  as the whole canvas would.
+     */
+    void complexScan(const std::vector<Edge>& edges, GBlitter* blitter) {
+        assert(edges.size() > 0);
+        const int height = fDevice.height();
+
+        /* counting sort of the edges by top scanline */
+        std::vector<int>& bucket = fBucket;
+        bucket.assign(height + 1, 0);
+        for (const Edge& e : edges) {
+            assert(e.top >= 0 && e.top < height);
+            bucket[e.top + 1]++;
+        }
+        for (int y = 0; y < height; y++) {
+            bucket[y + 1] += bucket[y];
+        }
+        std::vector<Edge>& pending = fPending;
+        pending.resize(edges.size());
+        for (const Edge& e : edges) {
+            pending[bucket[e.top]++] = e;
         }
-        //bool srcover = (blender == kSrcOver);
 
-        if (shader != nullptr) {
-            int count = x1 - x0;
-            assert(x0 >= 0 && count >= 0); 
-            GPixel row[count];
-            shader->shadeRow(x0, y, count, row);
-            
-            for (int x = x0; x < x1; x++) {
-                GPixel* addr = fDevice.getAddr(x, y);
-                //if (srcover) {
-                //    *addr = kSrcOver(row[x - x0], *addr);
-                //}
-                //else {
-                    *addr = blender(row[x - x0], *addr);
-                //}
+        std::vector<Edge*>& active = fActive;
+        active.clear();
+
+        size_t next = 0;
+        int y = pending[0].top;
+        if (y < fClip.fTop) {
+            y = fClip.fTop;
+            for (; next < pending.size() && pending[next].top < y; next++) {
+                Edge& e = pending[next];
+                if (e.isValid(y)) {
+                    /* the same steps it would have taken row by row */
+                    for (int i = e.top; i < y; i++) {
+                        e.currX += e.m;
+                    }
+                    active.push_back(&e);
+                }
             }
         }
-        else {
-            for (int x = x0; x < x1; x++) {
-                GPixel* addr = fDevice.getAddr(x, y);
-                //if (srcover) {
-                //    *addr = kSrcOver(src, *addr);
-                //}
-                //else {
-                    *addr = blender(src, *addr);
-                //}
+        while (next < pending.size() || active.size() > 0) {
+            if (active.size() == 0) {
+                /* skip empty rows */
+                y = pending[next].top;
+            }
+            if (y >= fClip.fBottom) {
+                break;
+            }
+            while (next < pending.size() && pending[next].top == y) {
+                active.push_back(&pending[next]);
+                next++;
             }
-        }
 
-    }
+            /* insertion sort by x, reusing the order from the previous row */
+            for (size_t i = 1; i < active.size(); i++) {
+                Edge* e = active[i];
+                size_t j = i;
+                while (j > 0 && (active[j - 1]->currX > e->currX ||
+                                 (active[j - 1]->currX == e->currX && active[j - 1] > e))) {
+                    active[j] = active[j - 1];
+                    j--;
+                }
+                active[j] = e;
+            }
 
-    void complexScan(std::vector<Edge> edges, const GPaint& paint) {
-        assert(edges.size() > 0);
-        
-        int x0;
-        int x1;
-        int y = edges[0].top;
-        while (edges.size() > 0) {
-            int index = 0;
             int w = 0;
-
-            while (index < edges.size() && edges.at(index).top <= y) {
+            int x0 = 0;
+            size_t keep = 0;
+            for (size_t i = 0; i < active.size(); i++) {
+                Edge* e = active[i];
                 if (w == 0) {
-                    x0 = edges.at(index).calculateX(y);
+                    x0 = e->calculateX(y);
                 }
 
-                w += edges.at(index).wind;
+                w += e->wind;
 
                 if (w == 0) {
-                    x1 = edges.at(index).calculateX(y);
-                    blit(x0, x1, y, paint);
+                    int x1 = e->calculateX(y);
+                    if (x0 < x1) {
+                        blitter->blitH(x0, y, x1 - x0);
+                    }
                 }
 
-                if (edges.at(index).isValid(y + 1) == false) {
-                    edges.erase(edges.begin() + index);
-                }
-                else {
-                    edges.at(index).currX += edges.at(index).m;
-                    index++;
+                /* retire finished edges by compacting the survivors */
+                if (e->isValid(y + 1)) {
+                    e->currX += e->m;
+                    active[keep++] = e;
                 }
             }
-
+            active.resize(keep);
             y++;
+        }
+    }
 
-            while (index < edges.size() && y == edges.at(index).top) {
-                index++;
-            }
-
-            std::sort(edges.begin(), edges.begin() + index, edgeComparisonX);
+    /*
+     *  Whether a segment (or the hull of a curve) is all above or all below the clip's rows,
+     *  so none of its edges could be drawn. A pixel to spare covers edges rounding their ends
+     *  to the nearest row.
+     */
+    bool outsideClipRows(const GPoint pts[], int count) const {
+        float top = pts[0].y();
+        float bottom = pts[0].y();
+        for (int i = 1; i < count; i++) {
+            top = std::min(top, pts[i].y());
+            bottom = std::max(bottom, pts[i].y());
         }
+        return bottom < fClip.fTop - 1 || top > fClip.fBottom + 1;
     }
 
     int numQuadSegments(GPoint pt[3]) { // sqrt(|d| / t)
@@ -707,20 +1017,639 @@ private:
     GPoint getCubicPt(GPoint src[4], float t) { // gets t as stored in dst[3] in chop cubic
         return (1 - t) * (1 - t) * (1 - t) * src[0] + 3 * t * (1 - t) * (1 - t) * src[1] + 3 * t * t * (1 - t) * src[2] + t * t * t * src[3];
     }
+};
+
+/*
+ *  Threaded canvas (see GCanvasOptions). Draws are recorded along with their CTM and the device
+ *  pixels they can touch, and on flush() each tile replays, in order, just the draws that
+ *  overlap it into a my_canvas clipped to the tile. Tiles never share pixels and a replay does
+ *  exactly what a plain my_canvas would do for those pixels, so the result does not depend on
+ *  how many threads there are or which thread gets which tile.
+ *
+ *  A mesh that spans tiles is binned a triangle at a time, so each tile draws just the
+ *  triangles whose bounds touch it (in their order in the mesh) instead of setting up every
+ *  one of them only to clip most away. Quads are recorded as the mesh they tessellate to, so
+ *  they get binned too. A path that spans tiles is scanned once, for the whole device, and
+ *  each tile blits just the spans that touch it. The binning and scanning run on the pool as
+ *  well, in runs of triangles (or a path each) whose size doesn't depend on the thread count.
+ *
+ *  Shaders may be gone by then, so a draw records its shading instead, one per worker: the
+ *  shader's contexts or pipeline stages (a mesh's moved to each triangle in place), with copies
+ *  of the pixels of the bitmaps its stages sample. Only shading that still needs the shader
+ *  flushes the draw right away.
+ */
+class my_tiledCanvas : public GCanvas {
+public:
+    my_tiledCanvas(const GBitmap& device, const GCanvasOptions& options)
+        : fDevice(device), fWrites(device), fTileSize(options.tileSize > 0 ? options.tileSize : 64),
+          fPool(options.threads) {
+        matrix = GMatrix();
+        stack.push(matrix);
+        fTilesX = (device.width() + fTileSize - 1) / fTileSize;
+        fTilesY = (device.height() + fTileSize - 1) / fTileSize;
+        fBins.resize(fTilesX * fTilesY);
+        for (int i = 0; i < fPool.threads(); i++) {
+            fCanvases.push_back(std::unique_ptr<my_canvas>(new my_canvas(device)));
+            fCanvases.back()->setReportsWrites(false);
+        }
+        fTriangles.resize(fPool.threads());
+    }
+
+    ~my_tiledCanvas() override {
+        flush();
+    }
+
+    void save() override {
+        stack.push(matrix);
+    }
+
+    void restore() override {
+        matrix = stack.top();
+        assert(stack.size() >= 1);
+        stack.pop();
+    }
+
+    void concat(const GMatrix& ctmMatrix) override {
+        matrix = matrix * ctmMatrix;
+    }
+
+    void drawPaint(const GPaint& paint) override {
+        drawRect(GRect::WH(fDevice.width(), fDevice.height()), paint);
+    }
+
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+        record(paint).setRect(rect);
+        finish();
+    }
+
+    void drawConvexPolygon(const GPoint points[], int count, const GPaint& paint) override {
+        if (count < 0) {
+            return;
+        }
+        record(paint).setPolygon(points, count);
+        finish();
+    }
+
+    void drawPath(const GPath& path, const GPaint& paint) override {
+        record(paint).setPath(path);
+        finish();
+    }
+
+    void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[], int count, const int indices[], const GPaint& paint) override {
+        record(paint).setMesh(verts, colors, texs, count, indices);
+        finish();
+    }
+
+    void drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4], int level, const GPaint& paint) override {
+        if (colors == nullptr && texs == nullptr) {
+            return;
+        }
+        if (level < 0) {
+            level = QuadLattice::AutoLevel(matrix, verts, colors, texs);
+        }
+        fQuad.set(verts, colors, texs, level);
+        drawMesh(fQuad.verts(), fQuad.colors(), fQuad.texs(), fQuad.triangles(), fQuad.indices(), paint);
+    }
+
+    void flush() override {
+        if (fCommandCount == 0) {
+            return;
+        }
+        int first = 0;
+        if (fFillFirst) {
+            /* in bands of whole rows, so each is one run (streamed if it is big enough) */
+            const Command& fill = fCommands[0];
+            const int bands = fPool.threads();
+            fPool.run(bands, [this, &fill, bands](int band, int worker) {
+                my_canvas& canvas = *fCanvases[worker];
+                canvas.setClip(GIRect::LTRB(0, fDevice.height() * band / bands,
+                                            fDevice.width(), fDevice.height() * (band + 1) / bands));
+                canvas.setCTM(fill.ctm);
+                fill.draw(&canvas);
+            });
+            fFillFirst = false;
+            first = 1;
+        }
+
+        for (std::vector<int>& bin : fBins) {
+            bin.clear();
+        }
+        for (int i = first; i < fCommandCount; i++) {
+            if (fCommands[i].staged) {
+                pointAtCopies(fCommands[i]);
+            }
+            const GIRect& b = fCommands[i].device;
+            if (b.isEmpty()) {
+                continue;
+            }
+            for (int ty = b.fTop / fTileSize; ty <= (b.fBottom - 1) / fTileSize; ty++) {
+                for (int tx = b.fLeft / fTileSize; tx <= (b.fRight - 1) / fTileSize; tx++) {
+                    fBins[ty * fTilesX + tx].push_back(i);
+                }
+            }
+        }
+
+        fChunkCount = 0;
+        fPaths.clear();
+        for (int i = first; i < fCommandCount; i++) {
+            Command& cmd = fCommands[i];
+            const GIRect& b = cmd.device;
+            if (b.isEmpty() ||
+                (b.fLeft / fTileSize == (b.fRight - 1) / fTileSize && b.fTop / fTileSize == (b.fBottom - 1) / fTileSize)) {
+                continue;
+            }
+            if (cmd.type == DrawCommand::kMesh) {
+                splitMesh(i);
+            }
+            else if (cmd.type == DrawCommand::kPath) {
+                cmd.scanned = true;
+                fPaths.push_back(i);
+            }
+        }
+        /* the meshes' runs of triangles, then the paths */
+        const int jobs = fChunkCount + (int)fPaths.size();
+        auto bin = [this](int job, int worker) {
+            if (job < fChunkCount) {
+                binTriangles(fChunks[job]);
+            }
+            else {
+                scanPath(fCommands[fPaths[job - fChunkCount]], worker);
+            }
+        };
+        if (jobs == 1) {
+            /* not worth waking the pool for */
+            bin(0, 0);
+        }
+        else if (jobs > 1) {
+            fPool.run(jobs, bin);
+        }
+
+        /* only the tiles something was binned to */
+        fTiles.clear();
+        for (int tile = 0; tile < fTilesX * fTilesY; tile++) {
+            if (!fBins[tile].empty()) {
+                fTiles.push_back(tile);
+            }
+        }
+        fPool.run((int)fTiles.size(), [this](int i, int worker) {
+            drawTile(fTiles[i], worker);
+        });
+        fWrites.pixelsChanged();
+
+        for (int i = 0; i < fCommandCount; i++) {
+            fCommands[i].reset();
+        }
+        fCommandCount = 0;
+        fCopiedPixels = 0;
+        fCopied.clear();
+    }
+
+private:
+    struct Command : DrawCommand {
+        GMatrix ctm;
+        GIRect device;  // pixels the draw can touch
+        /* a binned mesh's vertices mapped to the device, and its runs in fChunks */
+        std::vector<GPoint> devicePts;
+        int firstChunk, chunkCount;
+        /* a path scanned on flush: its spans per tile, in the order the scan blitted them */
+        std::vector<std::vector<Span>> spans;
+        bool scanned;
+        /* the shader's contexts or stages, one per worker, if recordShading took it out of paint */
+        std::vector<std::unique_ptr<GShader::Context>> contexts;
+        std::vector<std::unique_ptr<Pipeline>> pipelines;   // kept for their blocks
+        bool staged = false;                                // pipelines hold this draw's stages
+        bool shadedOpaque = false;
+        std::vector<size_t> copies;     // where the bitmaps the stages sample are in fCopies
+
+        void reset() {
+            DrawCommand::reset();
+            contexts.clear();
+            for (std::unique_ptr<Pipeline>& pipeline : pipelines) {
+                pipeline->reset();
+            }
+            staged = false;
+        }
+    };
+
+    /* A run of one binned mesh's triangles, and which of them touch each tile */
+    struct TriangleChunk {
+        int command;
+        int begin, end;
+        std::vector<std::vector<int>> bins;   // triangle numbers per tile, in order
+    };
+
+    /* Past this many recorded draws, or this many copied bitmap pixels (16 MB), we flush, to bound memory */
+    enum { kMaxCommands = 1024, kMaxCopiedPixels = 1 << 22 };
+    /* Triangles per binning job */
+    enum { kChunkTriangles = 4096 };
+    /* Bitmap pixels a draw may copy per pixel it draws, rather than flush (see copyReads) */
+    enum { kCopyRatio = 4 };
+
+    Command& record(const GPaint& paint) {
+        if (fCommandCount == (int)fCommands.size()) {
+            fCommands.emplace_back();
+        }
+        Command& cmd = fCommands[fCommandCount++];
+        cmd.ctm = matrix;
+        cmd.paint = paint;
+        cmd.chunkCount = 0;
+        cmd.scanned = false;
+        return cmd;
+    }
+
+    /*
+     *  Works out which pixels the last recorded draw can reach, then flushes if its paint has a
+     *  shader whose shading it can't make yet (we don't own the shader, so it may be gone once
+     *  this call returns) or there are too many draws queued up.
+     */
+    void finish() {
+        Command& cmd = fCommands[fCommandCount - 1];
+        GRect r;
+        cmd.device = GIRect::WH(fDevice.width(), fDevice.height());
+        if (cmd.bounds(&r)) {
+            GPoint corners[4] = {
+                { r.fLeft, r.fTop }, { r.fRight, r.fTop }, { r.fRight, r.fBottom }, { r.fLeft, r.fBottom },
+            };
+            cmd.ctm.mapPoints(corners, 4);
+            cmd.device = deviceBounds(corners, 4);
+        }
+        if (fillsDevice(cmd)) {
+            /* nothing recorded before it can show through, and it is drawn first on flush */
+            if (fCommandCount > 1) {
+                std::swap(fCommands[0], cmd);
+            }
+            for (int i = 1; i < fCommandCount; i++) {
+                fCommands[i].reset();
+            }
+            fCommandCount = 1;
+            fFillFirst = true;
+        }
+        else if ((cmd.paint.getShader() != nullptr && !recordShading(cmd)) || fCommandCount >= kMaxCommands ||
+                 fCopiedPixels >= kMaxCopiedPixels) {
+            flush();
+        }
+    }
+
+    /*
+     *  Makes cmd's shading up front, one per worker, and takes the shader out of its paint: the
+     *  shader's stages if it has them, otherwise its contexts, as my_canvas::setShader would.
+     *  A textured mesh's comes from the worker's canvas, made for the CTM and moved to each
+     *  triangle as it draws. False (and cmd draws with the shader) if the shading still needs
+     *  the shader, or the bitmaps its stages sample can't be copied (see copyReads).
+     */
+    bool recordShading(Command& cmd) {
+        GShader* shader = cmd.paint.getShader();
+        const bool mesh = cmd.type == DrawCommand::kMesh;
+        if (mesh && cmd.texs.empty() && !cmd.colors.empty()) {
+            /* the colors alone, my_canvas::drawMeshTriangles never looks at the shader */
+            cmd.paint.setShader(nullptr);
+            return true;
+        }
+        while ((int)cmd.pipelines.size() < fPool.threads()) {
+            cmd.pipelines.push_back(std::unique_ptr<Pipeline>(new Pipeline));
+        }
+        for (int i = 0; i < fPool.threads(); i++) {
+            Pipeline& pipeline = *cmd.pipelines[i];
+            std::unique_ptr<GShader::Context> context;
+            if (mesh && !cmd.texs.empty()) {
+                /* its triangles may still draw with a shader that can't draw with the CTM */
+                if (!fCanvases[i]->recordMeshShading(!cmd.colors.empty(), *shader, cmd.ctm, &pipeline, &context)) {
+                    cmd.contexts.clear();
+                    return false;
+                }
+            }
+            else {
+                pipeline.reset();
+                if (!shader->appendStages(&pipeline, cmd.ctm)) {
+                    pipeline.reset();
+                    context = shader->makeContext(cmd.ctm);
+                    if (context == nullptr) {
+                        /* nothing to draw, as in my_canvas::setShader */
+                        cmd.contexts.clear();
+                        cmd.device = GIRect::LTRB(0, 0, 0, 0);
+                        break;
+                    }
+                }
+            }
+            if (pipeline.empty() ? !context->canOutliveShader() : pipeline.keepsShaders()) {
+                cmd.contexts.clear();
+                return false;
+            }
+            if (pipeline.empty()) {
+                cmd.contexts.push_back(std::move(context));
+            }
+        }
+        cmd.staged = cmd.contexts.empty() && !cmd.pipelines[0]->empty();
+        if (cmd.staged && !copyReads(cmd)) {
+            cmd.staged = false;
+            return false;
+        }
+        cmd.shadedOpaque = shader->isOpaque();
+        cmd.paint.setShader(nullptr);
+        return true;
+    }
 
-    GColor findColor(const GColor colors[4], float u, float v) {
-        return (1.0f - u) * (1.0f - v) * colors[0] + u * (1.0f - v) * colors[1] + u * (v * colors[2]) + v * (1.0f - u) * colors[3];
+    /*
+     *  Copies the pixels of the bitmaps cmd's stages sample into fCopies, since the caller may
+     *  free them once the draw call returns (a bitmap drawn again shares its copy, see
+     *  copyPixels). False if one is our own device (its pixels change as the tiles draw), or
+     *  copying them would cost more than the draw itself (see kCopyRatio).
+     */
+    bool copyReads(Command& cmd) {
+        const std::vector<GBitmap*>& reads = cmd.pipelines[0]->reads();
+        size_t total = 0;
+        for (const GBitmap* bitmap : reads) {
+            const char* start = (const char*)bitmap->pixels();
+            const char* device = (const char*)fDevice.pixels();
+            if (start < device + fDevice.rowBytes() * fDevice.height() &&
+                device < start + bitmap->rowBytes() * bitmap->height()) {
+                return false;
+            }
+            total += (size_t)bitmap->width() * bitmap->height();
+        }
+        if (total > (size_t)kCopyRatio * cmd.device.width() * cmd.device.height()) {
+            return false;
+        }
+        if (fCopies.size() < fCopiedPixels + total) {
+            fCopies.resize(fCopiedPixels + total);
+        }
+        cmd.copies.clear();
+        for (const GBitmap* bitmap : reads) {
+            cmd.copies.push_back(copyPixels(*bitmap));
+        }
+        return true;
     }
 
-    GPoint findPoint(const GPoint points[4], float u, float v) {
-        return (1.0f - u) * (1.0f - v) * points[0] + u * (1.0f - v) * points[1] + u * (v * points[2]) + v * (1.0f - u) * points[3];
+    /*
+     *  Where bitmap's pixels are in fCopies: the copy of an earlier draw of the same pixels
+     *  since the last flush if they haven't changed since, otherwise a new one
+     */
+    size_t copyPixels(const GBitmap& bitmap) {
+        const size_t rowSize = bitmap.width() * sizeof(GPixel);
+        for (size_t i = fCopied.size(); i > 0; i--) {
+            const Copied& copied = fCopied[i - 1];
+            if (copied.bitmap.pixels() != bitmap.pixels() || copied.bitmap.width() != bitmap.width() ||
+                copied.bitmap.height() != bitmap.height() || copied.bitmap.rowBytes() != bitmap.rowBytes()) {
+                continue;
+            }
+            int y = 0;
+            while (y < bitmap.height() && memcmp(fCopies.data() + copied.offset + y * bitmap.width(),
+                                                 (const char*)bitmap.pixels() + y * bitmap.rowBytes(), rowSize) == 0) {
+                y++;
+            }
+            if (y == bitmap.height()) {
+                return copied.offset;
+            }
+            break;
+        }
+        const size_t offset = fCopiedPixels;
+        for (int y = 0; y < bitmap.height(); y++) {
+            memcpy(fCopies.data() + offset + y * bitmap.width(), (const char*)bitmap.pixels() + y * bitmap.rowBytes(),
+                   rowSize);
+        }
+        fCopied.push_back({ bitmap, offset });
+        fCopiedPixels += (size_t)bitmap.width() * bitmap.height();
+        return offset;
+    }
+
+    /* Points cmd's stages at their copies, on flush, once fCopies has stopped growing */
+    void pointAtCopies(Command& cmd) {
+        const std::vector<GBitmap*>& reads = cmd.pipelines[0]->reads();
+        for (size_t i = 0; i < reads.size(); i++) {
+            const GBitmap& bitmap = *reads[i];
+            GPixel* copy = fCopies.data() + cmd.copies[i];
+            const GBitmap copied(bitmap.width(), bitmap.height(), bitmap.width() * sizeof(GPixel), copy,
+                                 bitmap.isOpaque());
+            /* every worker's stages sample the same copy */
+            for (std::unique_ptr<Pipeline>& pipeline : cmd.pipelines) {
+                *pipeline->reads()[i] = copied;
+            }
+        }
     }
+
+    /*
+     *  Whether cmd stores one color into every pixel (a clear, or an opaque drawPaint), the
+     *  way my_canvas::drawAlignedRect and setBlitter would see it.
+     */
+    bool fillsDevice(const Command& cmd) const {
+        if (cmd.type != DrawCommand::kRect || cmd.rects.size() != 1 || cmd.paint.getShader() != nullptr ||
+            cmd.ctm[GMatrix::KX] != 0 || cmd.ctm[GMatrix::KY] != 0) {
+            return false;
+        }
+        const GPixel src = colorToPixel(cmd.paint.getColor().pinToUnit());
+        GBlendMode mode = reduceMode(cmd.paint.getBlendMode(), src);
+        if (GPixel_GetA(src) == 0xFF) {
+            mode = reduceModeOpaque(mode);
+        }
+        if (mode != GBlendMode::kSrc && mode != GBlendMode::kClear) {
+            return false;
+        }
+
+        const GRect& r = cmd.rects[0];
+        GPoint pts[2] = { { r.fLeft, r.fTop }, { r.fRight, r.fBottom } };
+        cmd.ctm.mapPoints(pts, pts, 2);
+        if (!std::isfinite(pts[0].fX) || !std::isfinite(pts[0].fY) ||
+            !std::isfinite(pts[1].fX) || !std::isfinite(pts[1].fY)) {
+            return false;
+        }
+        const float w = fDevice.width();
+        const float h = fDevice.height();
+        return GRoundToInt(std::min(pts[0].fX, pts[1].fX)) <= 0 &&
+               GRoundToInt(std::min(pts[0].fY, pts[1].fY)) <= 0 &&
+               GRoundToInt(std::max(pts[0].fX, pts[1].fX)) >= w &&
+               GRoundToInt(std::max(pts[0].fY, pts[1].fY)) >= h;
+    }
+
+    /* The pixels around device space points, all of them if one isn't finite */
+    GIRect deviceBounds(const GPoint points[], int count) const {
+        const GIRect device = GIRect::WH(fDevice.width(), fDevice.height());
+        if (count <= 0) {
+            return GIRect::LTRB(0, 0, 0, 0);
+        }
+        float l = INFINITY, t = INFINITY, r = -INFINITY, b = -INFINITY;
+        for (int i = 0; i < count; i++) {
+            const GPoint p = points[i];
+            if (!std::isfinite(p.fX) || !std::isfinite(p.fY)) {
+                return device;
+            }
+            l = std::min(l, p.fX);
+            t = std::min(t, p.fY);
+            r = std::max(r, p.fX);
+            b = std::max(b, p.fY);
+        }
+        /* edges round to the nearest pixel center, one pixel of slack covers that */
+        l = std::max(l - 1, (float)device.fLeft);
+        t = std::max(t - 1, (float)device.fTop);
+        r = std::min(r + 1, (float)device.fRight);
+        b = std::min(b + 1, (float)device.fBottom);
+        if (l >= r || t >= b) {
+            return GIRect::LTRB(0, 0, 0, 0);
+        }
+        return GIRect::LTRB(GFloorToInt(l), GFloorToInt(t), GCeilToInt(r), GCeilToInt(b));
+    }
+
+    /*
+     *  Maps the mesh's vertices to the device once, exactly as each tile's my_canvas would, and
+     *  splits its triangles into runs for binTriangles.
+     */
+    void splitMesh(int index) {
+        Command& cmd = fCommands[index];
+        cmd.devicePts.resize(cmd.pts.size());
+        cmd.ctm.mapPoints(cmd.devicePts.data(), cmd.pts.data(), (int)cmd.pts.size());
+        count(gVertexTransforms, cmd.pts.size());
+
+        cmd.firstChunk = fChunkCount;
+        for (int begin = 0; begin < cmd.count; begin += kChunkTriangles) {
+            if (fChunkCount == (int)fChunks.size()) {
+                fChunks.emplace_back();
+            }
+            TriangleChunk& chunk = fChunks[fChunkCount++];
+            chunk.command = index;
+            chunk.begin = begin;
+            chunk.end = std::min(begin + (int)kChunkTriangles, cmd.count);
+            cmd.chunkCount++;
+        }
+    }
+
+    /* Keeps each span a path's scan blits in the bins of the tiles it covers */
+    class SpanBinner : public GBlitter {
+    public:
+        SpanBinner(std::vector<std::vector<Span>>& bins, int tileSize, int tilesX)
+            : fBins(bins), fTileSize(tileSize), fTilesX(tilesX) {}
+
+        void blitH(int x, int y, int width) override {
+            const int left = std::max(x, 0) / fTileSize;
+            const int right = std::min(x + width - 1, fTilesX * fTileSize - 1) / fTileSize;
+            for (int tx = left; tx <= right; tx++) {
+                fBins[y / fTileSize * fTilesX + tx].push_back({ x, y, width });
+            }
+        }
+
+    private:
+        std::vector<std::vector<Span>>& fBins;
+        const int fTileSize;
+        const int fTilesX;
+    };
+
+    /* Scans the path once, on the worker's canvas, into its tiles' bins of spans */
+    void scanPath(Command& cmd, int worker) {
+        cmd.spans.resize(fTilesX * fTilesY);
+        for (std::vector<Span>& bin : cmd.spans) {
+            bin.clear();
+        }
+        SpanBinner binner(cmd.spans, fTileSize, fTilesX);
+        my_canvas& canvas = *fCanvases[worker];
+        canvas.setCTM(cmd.ctm);
+        canvas.scanPath(cmd.path, &binner);
+    }
+
+    /* Adds each triangle of the chunk to the bins of the tiles its pixel bounds touch */
+    void binTriangles(TriangleChunk& chunk) {
+        chunk.bins.resize(fTilesX * fTilesY);
+        for (std::vector<int>& bin : chunk.bins) {
+            bin.clear();
+        }
+        const Command& cmd = fCommands[chunk.command];
+        for (int i = chunk.begin; i < chunk.end; i++) {
+            const int* index = &cmd.indices[3 * i];
+            const GPoint pts[3] = { cmd.devicePts[index[0]], cmd.devicePts[index[1]], cmd.devicePts[index[2]] };
+            const GIRect b = deviceBounds(pts, 3);
+            if (b.isEmpty()) {
+                continue;
+            }
+            for (int ty = b.fTop / fTileSize; ty <= (b.fBottom - 1) / fTileSize; ty++) {
+                for (int tx = b.fLeft / fTileSize; tx <= (b.fRight - 1) / fTileSize; tx++) {
+                    chunk.bins[ty * fTilesX + tx].push_back(i);
+                }
+            }
+        }
+    }
+
+    void drawTile(int tile, int worker) {
+        my_canvas& canvas = *fCanvases[worker];
+        const int tx = tile % fTilesX;
+        const int ty = tile / fTilesX;
+        canvas.setClip(GIRect::LTRB(tx * fTileSize, ty * fTileSize,
+                                    std::min((tx + 1) * fTileSize, fDevice.width()),
+                                    std::min((ty + 1) * fTileSize, fDevice.height())));
+
+        for (int index : fBins[tile]) {
+            const Command& cmd = fCommands[index];
+            canvas.setCTM(cmd.ctm);
+            canvas.setRecordedShading(cmd.contexts.empty() ? nullptr : cmd.contexts[worker].get(),
+                                      cmd.staged ? cmd.pipelines[worker].get() : nullptr, cmd.shadedOpaque);
+            if (cmd.chunkCount == 0) {
+                if (cmd.scanned) {
+                    const std::vector<Span>& spans = cmd.spans[tile];
+                    if (!spans.empty()) {
+                        canvas.drawSpans(spans.data(), (int)spans.size(), cmd.paint);
+                    }
+                }
+                else {
+                    cmd.draw(&canvas);
+                }
+            }
+            else {
+                /* the mesh's triangles for this tile, still in the mesh's order */
+                std::vector<int>& triangles = fTriangles[worker];
+                triangles.clear();
+                for (int c = cmd.firstChunk; c < cmd.firstChunk + cmd.chunkCount; c++) {
+                    const std::vector<int>& bin = fChunks[c].bins[tile];
+                    triangles.insert(triangles.end(), bin.begin(), bin.end());
+                }
+                if (!triangles.empty()) {
+                    canvas.drawMeshTriangles(cmd.pts.data(), cmd.devicePts.data(),
+                                             cmd.colors.size() ? cmd.colors.data() : nullptr,
+                                             cmd.texs.size() ? cmd.texs.data() : nullptr, cmd.indices.data(),
+                                             triangles.data(), (int)triangles.size(), cmd.paint);
+                }
+            }
+            canvas.setRecordedShading(nullptr, nullptr, false);
+        }
+    }
+
+    const GBitmap fDevice;
+    MipPyramid::Writer fWrites;     // each flush, for pyramids of the device's pixels
+    std::stack<GMatrix> stack;
+    GMatrix matrix;
+
+    const int fTileSize;
+    int fTilesX;
+    int fTilesY;
+
+    std::deque<Command> fCommands;          // a deque, so growing it never copies their contexts
+    int fCommandCount = 0;
+    std::vector<std::vector<int>> fBins;   // command indices per tile, in draw order
+    std::vector<int> fTiles;                // the tiles with a non-empty bin, for flush
+    std::vector<TriangleChunk> fChunks;     // the binned meshes' triangles, first fChunkCount in use
+    int fChunkCount = 0;
+    std::vector<int> fPaths;                // the commands of the paths scanned on flush
+    std::vector<GPixel> fCopies;            // copyReads' copies, kept for its capacity
+    struct Copied {
+        GBitmap bitmap;     // the pixels it was copied from
+        size_t offset;      // in fCopies
+    };
+    std::vector<Copied> fCopied;            // since the last flush
+    size_t fCopiedPixels = 0;               // of fCopies in use, since the last flush
+    bool fFillFirst = false;                // fCommands[0] fills the device, see fillsDevice
+    QuadLattice fQuad;
+
+    ThreadPool fPool;
+    std::vector<std::unique_ptr<my_canvas>> fCanvases;  // one per worker
+    std::vector<std::vector<int>> fTriangles;           // one per worker, for drawTile
 };
 
 std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& device) {
     return std::unique_ptr<GCanvas>(new my_canvas(device));
 }
 
+std::unique_ptr<GCanvas> GCreateCanvas(const GBitmap& device, const GCanvasOptions& options) {
+    if (options.threads <= 1) {
+        return GCreateCanvas(device);
+    }
+    return std::unique_ptr<GCanvas>(new my_tiledCanvas(device, options));
+}
+
 static void draw_tri(GCanvas* canvas) {
     const GPoint pts[] = {
         { 10, 10 }, { 400, 100 }, { 250, 400 },
@@ -5,6 +5,7 @@
 #include "GMatrix.h"
 #include "GShader.h"
 #include "blendModes.h"
+#include "pipeline.h"
 
 class my_compositeShader : public GShader {
 public:
@@ -12,16 +13,33 @@ public:
     }
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
-    bool isOpaque() override {
+    bool isOpaque() const override {
         return s0->isOpaque() && s1->isOpaque();
     }
 
-    // The draw calls in GCanvas must call this with the CTM before any calls to shadeSpan().
-    bool setContext(const GMatrix& ctm) override {
-        return s0->setContext(ctm) && s1->setContext(ctm);
+    std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+        std::unique_ptr<Context> c0 = s0->makeContext(ctm);
+        std::unique_ptr<Context> c1 = s1->makeContext(ctm);
+        if (!c0 || !c1) {
+            return nullptr;
+        }
+        return std::unique_ptr<Context>(new CompositeContext(std::move(c0), std::move(c1)));
+    }
+
+    /* a shader without stages of its own is shaded by its context, in the same loop */
+    bool appendStages(Pipeline* pipeline, const GMatrix& ctm) const override {
+        if (!s0->appendStages(pipeline, ctm) && !pipeline->appendContext(*s0, ctm)) {
+            return false;
+        }
+        pipeline->appendSave();
+        if (!s1->appendStages(pipeline, ctm) && !pipeline->appendContext(*s1, ctm)) {
+            return false;
+        }
+        pipeline->appendModulate();
+        return true;
     }
 
-    GPixel multPixels(GPixel p0, GPixel p1) {
+    static GPixel multPixels(GPixel p0, GPixel p1) {
         unsigned r, g, b, a;
         r = dividePixel(GPixel_GetR(p0) * GPixel_GetR(p1));
         g = dividePixel(GPixel_GetG(p0) * GPixel_GetG(p1));
@@ -31,24 +49,41 @@ public:
         return GPixel_PackARGB(a, r, g, b);
     }
 
-    /**
-     *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
-     *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
-     *  can hold at least [count] entries.
-     */
-    void shadeRow(int x, int y, int count, GPixel row[]) override {
-        GPixel p0[count];
-        GPixel p1[count];
-
-        s0->shadeRow(x, y, count, p0);
-        s1->shadeRow(x, y, count, p1);
-        for (int i = 0; i < count; i++) {
-            row[i] = multPixels(p0[i], p1[i]);// need to add multPixels function
+private:
+    class CompositeContext : public Context {
+    public:
+        CompositeContext(std::unique_ptr<Context> c0, std::unique_ptr<Context> c1)
+            : fC0(std::move(c0)), fC1(std::move(c1)) {}
+
+        bool setCTM(const GMatrix& ctm) override {
+            return fC0->setCTM(ctm) && fC1->setCTM(ctm);
         }
-    }
 
+        bool canOutliveShader() const override {
+            return fC0->canOutliveShader() && fC1->canOutliveShader();
+        }
+
+        /* a row is the span that starts at x, shaded into the same scratch rows */
+        void shadeRow(int x, int y, int count, GPixel row[]) override {
+            shadeSpan(x, x, y, count, row);
+        }
+
+        void shadeSpan(int start, int x, int y, int count, GPixel row[]) override {
+            fP0.resize(count);
+            fP1.resize(count);
+            fC0->shadeSpan(start, x, y, count, fP0.data());
+            fC1->shadeSpan(start, x, y, count, fP1.data());
+            for (int i = 0; i < count; i++) {
+                row[i] = multPixels(fP0[i], fP1[i]);
+            }
+        }
+
+    private:
+        std::unique_ptr<Context> fC0;
+        std::unique_ptr<Context> fC1;
+        std::vector<GPixel> fP0, fP1;   // each one's colors for a span, kept for their capacity
+    };
 
-private:
    GShader* s0;
    GShader* s1;
 };
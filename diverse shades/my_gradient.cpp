@@ -2,8 +2,17 @@
 #include "GMatrix.h"
 #include "GMath.h"
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
 #include <vector>
 
+#if defined(__SSE2__)
+	#include <immintrin.h>
+#endif
+
 
 int float2Pixel(float value) {
 	return floor(value * 255 + 0.5);
@@ -17,22 +26,100 @@ GPixel color2Pixel(const GColor& c) {
 	return GPixel_PackARGB(a, r, g, b);
 }
 
-class my_gradient: public GShader {
+/*
+ *  4 floats at a time, with the GCC/Clang vector extensions (SSE registers on x86, NEON on ARM).
+ *  Comparisons give -1 (all bits) or 0 in each lane of an I4.
+ */
+typedef float F4 __attribute__((vector_size(16)));
+typedef int32_t I4 __attribute__((vector_size(16)));
+
+static inline F4 splat4(float v) {
+	return F4{ v, v, v, v };
+}
+
+static inline F4 select4(I4 mask, F4 a, F4 b) {
+	return (F4)((mask & (I4)a) | (~mask & (I4)b));
+}
+
+/* min and max of a and b, lane by lane, b where either is NaN (like minps and maxps) */
+static inline F4 min4(F4 a, F4 b) {
+#if defined(__SSE2__)
+	return (F4)_mm_min_ps((__m128)a, (__m128)b);
+#else
+	return select4(a < b, a, b);
+#endif
+}
+
+static inline F4 max4(F4 a, F4 b) {
+#if defined(__SSE2__)
+	return (F4)_mm_max_ps((__m128)a, (__m128)b);
+#else
+	return select4(a > b, a, b);
+#endif
+}
+
+static inline F4 abs4(F4 v) {
+	const int32_t bits = 0x7FFFFFFF;
+	return (F4)((I4)v & I4{ bits, bits, bits, bits });
+}
+
+static inline F4 sqrt4(F4 v) {
+#if defined(__SSE2__)
+	return (F4)_mm_sqrt_ps((__m128)v);
+#else
+	return F4{ sqrtf(v[0]), sqrtf(v[1]), sqrtf(v[2]), sqrtf(v[3]) };
+#endif
+}
+
+/*
+ *  The angle of (x, y) from the +x axis towards +y, in turns [0, 1]. atan on [0, 1] is a
+ *  polynomial (max error about 1e-5 radians), the other octants are reflections of it.
+ */
+static inline F4 turns4(F4 y, F4 x) {
+	const F4 ax = abs4(x);
+	const F4 ay = abs4(y);
+	const I4 steep = ay > ax;
+	const F4 mx = select4(steep, ay, ax);
+	const F4 mn = select4(steep, ax, ay);
+	/* (0, 0) has no angle, call it 0 */
+	const F4 a = select4(mx > splat4(0), mn / mx, splat4(0));
+
+	const F4 s = a * a;
+	F4 r = splat4(-0.01172120f);
+	r = r * s + splat4(0.05265332f);
+	r = r * s + splat4(-0.11643287f);
+	r = r * s + splat4(0.19354346f);
+	r = r * s + splat4(-0.33262347f);
+	r = r * s + splat4(0.99997726f);
+	r = r * a;
+
+	r = select4(steep, splat4(M_PI / 2) - r, r);
+	r = select4(x < splat4(0), splat4(M_PI) - r, r);
+	r = select4(y < splat4(0), splat4(2 * M_PI) - r, r);
+	return r * splat4(1 / (2 * M_PI));
+}
+
+/*
+ *  What every gradient shares: the colors, baked into a premultiplied LUT when the shader is
+ *  made, and the tile modes, which fold t (0 at the first color, 1 at the last) into [0, 1] in
+ *  32.32 fixed point before it picks the nearest LUT entry.
+ */
+class my_gradientBase : public GShader {
 public:
-	my_gradient(GPoint p0, GPoint p1, const GColor colors[], int count, GShader::TileMode tileMode) : fcount(count), tile(tileMode) {
+	my_gradientBase(const GColor colors[], int count, GShader::TileMode tileMode)
+		: fcount(count), tile(tileMode), fLut(new GPixel[kLutSize], std::default_delete<GPixel[]>()) {
 		for (int i = 0; i < count; i++){
 			colorsArr.push_back(colors[i]);
 		}
-
-		fCTM = GMatrix();
-
-		deltaX = p1.x() - p0.x();
-		float deltaY = p1.y() - p0.y();
-
-		fLocalMatrix = GMatrix(deltaX, -deltaY, p0.x(), deltaY, deltaX, p0.y());
+		GPixel* lut = fLut.get();
+		fUniform = true;
+		for (int i = 0; i < kLutSize; i++) {
+			lut[i] = color2Pixel(colorAt((float)i / (kLutSize - 1)));
+			fUniform = fUniform && lut[i] == lut[0];
+		}
 	}
 
-	bool isOpaque() {
+	bool isOpaque() const override {
 		for (int i = 0; i < fcount; i++) {
 			if (colorsArr[i].a != 1.0) {
 				return false;
@@ -41,74 +128,455 @@ public:
 		return true;
 	}
 
-	bool setContext(const GMatrix& ctm) override {
-		return (ctm * fLocalMatrix).invert(&fCTM);
+protected:
+	/* fLut[i] is the color at t = i / (kLutSize - 1) */
+	enum { kLutSize = 1024 };
+
+	GColor colorAt(float t) const {
+		float x = t * (fcount - 1);
+		int index = GFloorToInt(x);
+		float w = x - index;
+		if (w == 0) {
+			assert(index <= fcount - 1);
+			return colorsArr[index];
+		}
+		return colorsArr[index] + (colorsArr[index + 1] - colorsArr[index]) * w;
 	}
 
-	float clamp(GPoint point) {
-		float px = point.x();
-		if (point.x() < 0.0) {
-			px = 0;
+	/* Makes Ctx<M> for this shader's tile mode, from (fLut, fUniform, args...) */
+	template <template <TileMode> class Ctx, typename... Args>
+	std::unique_ptr<Context> makeTiled(Args&&... args) const {
+		switch (tile) {
+			case TileMode::kRepeat:
+				return std::unique_ptr<Context>(new Ctx<TileMode::kRepeat>(fLut, fUniform, args...));
+			case TileMode::kMirror:
+				return std::unique_ptr<Context>(new Ctx<TileMode::kMirror>(fLut, fUniform, args...));
+			default:
+				return std::unique_ptr<Context>(new Ctx<TileMode::kClamp>(fLut, fUniform, args...));
 		}
-		if (point.x() > 1.0) {
-			px = 1;
+	}
+
+	/* past this t has no fraction left in float, and 32.32 could overflow along a row */
+	static float pinT(float t) {
+		const float kMaxT = 1 << 24;
+		return std::max(-kMaxT, std::min(t, kMaxT));
+	}
+
+	template <TileMode M>
+	static int lutIndex(int64_t t) {
+		const int64_t kOne = (int64_t)1 << 32;
+		switch (M) {
+			case TileMode::kClamp:
+				t = std::max((int64_t)0, std::min(t, kOne));
+				break;
+			case TileMode::kRepeat:
+				t &= kOne - 1;
+				break;
+			case TileMode::kMirror:
+				t &= 2 * kOne - 1;
+				if (t > kOne) {
+					t = 2 * kOne - t;
+				}
+				break;
 		}
-		return px;
+		return (int)((t * (kLutSize - 1) + kOne / 2) >> 32);
 	}
 
-	float repeat(float val) {
-		return val - floor(val);
+	/* floor(v) for |v| <= 2^24 (NaN stays NaN) */
+	static F4 floor4(F4 v) {
+		const F4 trunc = __builtin_convertvector(__builtin_convertvector(v, I4), F4);
+		/* the mask is -1 where truncating went up */
+		return trunc + __builtin_convertvector((I4)(trunc > v), F4);
 	}
 
-	float mirror(float val) {
-		val *= 0.5;
-		float x = val - floor(val);
-		if (x > 0.5) {
-			return 2 * (1 - x);
+	/*
+	 *  t folded into [0, 1] by the tile mode, in float: the same steps, and rounding, as
+	 *  x - floor(x). Past 2^24 floats are even integers, which fold to 0 however big they are,
+	 *  so pinning t there changes nothing.
+	 */
+	template <TileMode M>
+	static F4 fold(F4 t) {
+		const F4 kMaxT = splat4(1 << 24);
+		switch (M) {
+			case TileMode::kClamp:
+				return min4(max4(t, splat4(0)), splat4(1));
+			case TileMode::kRepeat:
+				t = min4(max4(t, -kMaxT), kMaxT);
+				return t - floor4(t);
+			case TileMode::kMirror: {
+				t = min4(max4(t, -kMaxT), kMaxT);
+				const F4 half = t * splat4(0.5f);
+				const F4 x = half - floor4(half);
+				/* x > 0.5 ? 2 * (1 - x) : 2 * x, both of which are exact */
+				return min4(splat4(2) * x, splat4(2) - splat4(2) * x);
+			}
 		}
-		return 2 * x;
+		return t;
+	}
+
+	/* the nearest entries to t in [0, 1], or the first for NaN */
+	static I4 lutIndex4(F4 t) {
+		const F4 index = t * splat4(kLutSize - 1) + splat4(0.5f);
+		return __builtin_convertvector(select4(index >= splat4(0), index, splat4(0)), I4);
 	}
 
-	void shadeRow(int x, int y, int count, GPixel row[]) {
+	/* row[i] is the color at t[i], or transparent where t[i] is NaN (no color there at all) */
+	template <TileMode M>
+	static void lookupRow(const GPixel lut[], const float t[], int count, GPixel row[]) {
 		for (int i = 0; i < count; i++) {
-			GPoint point = { x + 0.5f + i, y + 0.5f };
-			GPoint lm = fCTM * point;
-			GColor color;
+			/* t in 32.32, truncated: the bits rounding could change are far below a LUT step */
+			const int64_t ft = (int64_t)((double)pinT(t[i]) * 4294967296.0);
+			row[i] = t[i] == t[i] ? lut[lutIndex<M>(ft)] : 0;
+		}
+	}
 
-			float px; // will edit value accordn=ing to tilemode
-			if (tile == TileMode::kMirror) {
-				px = mirror(lm.fX); //mirror image
+	/*
+	 *  The context the radial, conical and sweep gradients share: a chunk of pixels at a time,
+	 *  Eval (4 pixels per call) computes t from the pixels' points in the gradient's own space,
+	 *  then lookupRow turns them into colors. fInv takes device points to that space.
+	 *
+	 *  With a single color it is the same everywhere, as long as Eval::everywhere() says every
+	 *  point has a t (none are left transparent).
+	 */
+	template <TileMode M, typename Eval>
+	class SpanContext : public Context {
+	public:
+		SpanContext(const std::shared_ptr<GPixel>& lut, bool uniform, const GMatrix& local, const GMatrix& inv, const Eval& eval)
+			: fLutOwner(lut), fLut(lut.get()), fLocal(local), fInv(inv), fEval(eval),
+			  fKind(uniform && eval.everywhere() ? kConstant : kGeneral) {}
+
+		Kind kind() const override {
+			return fKind;
+		}
+
+		/* it has its own share of the LUT */
+		bool canOutliveShader() const override {
+			return true;
+		}
+
+		/* nothing but fInv depends on the CTM */
+		bool setCTM(const GMatrix& ctm) override {
+			return (ctm * fLocal).invert(&fInv);
+		}
+
+		/* each pixel's t comes from its own point */
+		void shadeSpan(int start, int x, int y, int count, GPixel row[]) override {
+			shadeRow(x, y, count, row);
+		}
+
+		void shadeRow(int x, int y, int count, GPixel row[]) override {
+			enum { kChunk = 64 };
+			float t[kChunk];
+
+			/* pixel x + i maps to (sx, ky) * (x + i + 0.5) + (bx, by) */
+			const float py = y + 0.5f;
+			const F4 sx = splat4(fInv[GMatrix::SX]);
+			const F4 ky = splat4(fInv[GMatrix::KY]);
+			const F4 bx = splat4(fInv[GMatrix::KX] * py + fInv[GMatrix::TX]);
+			const F4 by = splat4(fInv[GMatrix::SY] * py + fInv[GMatrix::TY]);
+			F4 px = splat4(x + 0.5f) + F4{ 0, 1, 2, 3 };
+
+			while (count > 0) {
+				const int n = std::min(count, (int)kChunk);
+				/* n rounded up to 4, t has room */
+				for (int i = 0; i < n; i += 4) {
+					const F4 ti = fEval(sx * px + bx, ky * px + by);
+					memcpy(t + i, &ti, sizeof(ti));
+					px += splat4(4);
+				}
+				lookupRow<M>(fLut, t, n, row);
+				row += n;
+				count -= n;
 			}
-			else if (tile == TileMode::kRepeat) {
-				px = repeat(lm.fX); // repeat image
+		}
+
+	private:
+		const std::shared_ptr<const GPixel> fLutOwner;
+		const GPixel* fLut;
+		const GMatrix fLocal;   // the shader's
+		GMatrix fInv;
+		const Eval fEval;
+		const Kind fKind;
+	};
+
+	int fcount;
+	std::vector<GColor> colorsArr;
+	GShader::TileMode tile;
+	std::shared_ptr<GPixel> fLut;   // kLutSize entries, shared with the contexts
+	bool fUniform;                  // every entry of fLut is the same
+};
+
+class my_gradient: public my_gradientBase {
+public:
+	my_gradient(GPoint p0, GPoint p1, const GColor colors[], int count, GShader::TileMode tileMode) : my_gradientBase(colors, count, tileMode) {
+		deltaX = p1.x() - p0.x();
+		float deltaY = p1.y() - p0.y();
+
+		fLocalMatrix = GMatrix(deltaX, -deltaY, p0.x(), deltaY, deltaX, p0.y());
+	}
+
+	std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+		GMatrix inverse;
+		if (!(ctm * fLocalMatrix).invert(&inverse)) {
+			return nullptr;
+		}
+		return makeTiled<GradientContext>(fLocalMatrix, inverse);
+	}
+
+private:
+	/*
+	 *  fCTM takes device points to the unit gradient, so t only changes by fCTM[SX] from one
+	 *  pixel to the next. t is still mapped for each pixel, 4 at a time and rounded exactly the
+	 *  way fCTM * point does, and folded by the tile mode in float: stepping it instead drifts
+	 *  from that by a few ulps, which is enough at a repeat or mirror seam to land on the other
+	 *  side of it and pick the color from the other end.
+	 *
+	 *  When that step is 0 (the gradient is vertical on the device) each row is one color, and
+	 *  the canvas only asks for one pixel of it. When t doesn't depend on y (horizontal) every
+	 *  row is the same, so the last one is kept and copied out again for the next row that
+	 *  starts at the same x.
+	 */
+	template <TileMode M>
+	class GradientContext : public Context {
+	public:
+		GradientContext(const std::shared_ptr<GPixel>& lut, bool uniform, const GMatrix& local, const GMatrix& inverse)
+			: fLutOwner(lut), fLut(lut.get()), fUniform(uniform), fLocal(local) {
+			setInverse(inverse);
+		}
+
+		Kind kind() const override {
+			return fKind;
+		}
+
+		/* it has its own share of the LUT */
+		bool canOutliveShader() const override {
+			return true;
+		}
+
+		bool setCTM(const GMatrix& ctm) override {
+			GMatrix inverse;
+			if (!(ctm * fLocal).invert(&inverse)) {
+				return false;
+			}
+			setInverse(inverse);
+			return true;
+		}
+
+		/* t is mapped for each pixel, so it doesn't matter where the span starts */
+		void shadeSpan(int start, int x, int y, int count, GPixel row[]) override {
+			shadeRow(x, y, count, row);
+		}
+
+		void shadeRow(int x, int y, int count, GPixel row[]) override {
+			if (!fSameRows) {
+				shade(x, y, count, row);
+				return;
 			}
-			else {
-				px = clamp(lm); //clamp
+			if (x != fCachedX || count > (int)fCachedRow.size()) {
+				fCachedRow.resize(count);
+				fCachedX = x;
+				shade(x, y, count, fCachedRow.data());
 			}
+			memcpy(row, fCachedRow.data(), count * sizeof(GPixel));
+		}
+
+	private:
+		void setInverse(const GMatrix& inverse) {
+			fCTM = inverse;
+			fKind = fUniform || (fCTM[GMatrix::SX] == 0 && fCTM[GMatrix::KX] == 0) ? kConstant
+			        : fCTM[GMatrix::SX] == 0 ? kConstantRows : kGeneral;
+			fSameRows = fKind == kGeneral && fCTM[GMatrix::KX] == 0;
+			/* empty (but not freed), so the next row is shaded again */
+			fCachedX = 0;
+			fCachedRow.clear();
+		}
 
+		void shade(int x, int y, int count, GPixel row[]) const {
+			/* (SX * px + KX * py) + TX, with px = (x + 0.5) + i like the point fCTM maps */
+			const F4 sx = splat4(fCTM[GMatrix::SX]);
+			const F4 kyPy = splat4(fCTM[GMatrix::KX] * (y + 0.5f));
+			const F4 tx = splat4(fCTM[GMatrix::TX]);
+			const F4 px0 = splat4(x + 0.5f);
+			F4 i4 = F4{ 0, 1, 2, 3 };
 
-			float x = px * (fcount - 1);
-			int index = GFloorToInt(x);
-			float w = x - index;
-			if (w == 0) {
-				assert(index <= fcount - 1);
-				color = colorsArr.at(index);
-			}else{
-				color = colorsArr.at(index) + (colorsArr.at(index + 1) - colorsArr.at(index)) * w;
+			enum { kChunk = 64 };
+			int32_t index[kChunk];
+			while (count > 0) {
+				const int n = std::min(count, (int)kChunk);
+				/* n rounded up to 4, index has room */
+				for (int i = 0; i < n; i += 4) {
+					const I4 i4Index = lutIndex4(fold<M>(sx * (px0 + i4) + kyPy + tx));
+					memcpy(index + i, &i4Index, sizeof(i4Index));
+					i4 += splat4(4);
+				}
+				for (int i = 0; i < n; i++) {
+					row[i] = fLut[index[i]];
+				}
+				row += n;
+				count -= n;
 			}
-			row[i] = color2Pixel(color);
 		}
+
+		const std::shared_ptr<const GPixel> fLutOwner;
+		const GPixel* fLut;
+		const bool fUniform;
+		const GMatrix fLocal;   // the shader's
+		GMatrix fCTM;
+		Kind fKind;
+		bool fSameRows;
+
+		int fCachedX;                       // fCachedRow starts at this x, on every row
+		std::vector<GPixel> fCachedRow;
+	};
+
+	float deltaX;
+	GMatrix fLocalMatrix;
+};
+
+/* t is the distance from the center, in radii */
+class my_radialGradient : public my_gradientBase {
+public:
+	my_radialGradient(GPoint center, float radius, const GColor colors[], int count, GShader::TileMode tileMode)
+		: my_gradientBase(colors, count, tileMode),
+		  fLocalMatrix(GMatrix::Translate(center.x(), center.y()) * GMatrix::Scale(radius, radius)) {}
+
+	std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+		GMatrix inverse;
+		if (!(ctm * fLocalMatrix).invert(&inverse)) {
+			return nullptr;
+		}
+		return makeTiled<RadialContext>(fLocalMatrix, inverse, Eval());
+	}
+
+private:
+	struct Eval {
+		bool everywhere() const {
+			return true;
+		}
+
+		F4 operator()(F4 x, F4 y) const {
+			return sqrt4(x * x + y * y);
+		}
+	};
+
+	template <TileMode M>
+	using RadialContext = SpanContext<M, Eval>;
+
+	GMatrix fLocalMatrix;
+};
+
+/*
+ *  The circles (c0 + t * (c1 - c0), r0 + t * (r1 - r0)) for every t, and each point takes the
+ *  biggest t whose circle (with a radius >= 0) passes through it. Points on no such circle are
+ *  left transparent. Relative to c0, with cd = c1 - c0 and dr = r1 - r0, that's the biggest
+ *  root of
+ *
+ *      (cd.cd - dr^2) t^2 - 2 (p.cd + r0 dr) t + (p.p - r0^2) = 0
+ */
+class my_conicalGradient : public my_gradientBase {
+public:
+	my_conicalGradient(GPoint c0, float r0, GPoint c1, float r1, const GColor colors[], int count, GShader::TileMode tileMode)
+		: my_gradientBase(colors, count, tileMode), fLocalMatrix(GMatrix::Translate(c0.x(), c0.y())) {
+		fEval.cdx = c1.x() - c0.x();
+		fEval.cdy = c1.y() - c0.y();
+		fEval.r0 = r0;
+		fEval.dr = r1 - r0;
+		fEval.a = fEval.cdx * fEval.cdx + fEval.cdy * fEval.cdy - fEval.dr * fEval.dr;
 	}
 
+	/* one circle strictly inside the other covers the whole plane */
+	bool isOpaque() const override {
+		return fEval.everywhere() && my_gradientBase::isOpaque();
+	}
 
+	std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+		GMatrix inverse;
+		if (!(ctm * fLocalMatrix).invert(&inverse)) {
+			return nullptr;
+		}
+		return makeTiled<ConicalContext>(fLocalMatrix, inverse, fEval);
+	}
 
 private:
-	int fcount;
-	float deltaX;
+	struct Eval {
+		float cdx, cdy, r0, dr, a;
+
+		bool everywhere() const {
+			return a < 0;
+		}
+
+		F4 operator()(F4 x, F4 y) const {
+			const F4 b = x * splat4(cdx) + y * splat4(cdy) + splat4(r0 * dr);
+			const F4 c = x * x + y * y - splat4(r0 * r0);
+			const F4 none = splat4(NAN);
+
+			if (a == 0) {
+				/* only one root */
+				const F4 t = c / (splat4(2) * b);
+				return select4((b != splat4(0)) & (radius(t) >= splat4(0)), t, none);
+			}
+			const F4 disc = b * b - splat4(a) * c;
+			const F4 root = sqrt4(select4(disc > splat4(0), disc, splat4(0)));
+			const F4 t0 = (b + root) / splat4(a);
+			const F4 t1 = (b - root) / splat4(a);
+			const F4 big = a > 0 ? t0 : t1;
+			const F4 small = a > 0 ? t1 : t0;
+
+			F4 t = select4(radius(small) >= splat4(0), small, none);
+			t = select4(radius(big) >= splat4(0), big, t);
+			return select4(disc >= splat4(0), t, none);
+		}
+
+		F4 radius(F4 t) const {
+			return splat4(r0) + t * splat4(dr);
+		}
+	};
+
+	template <TileMode M>
+	using ConicalContext = SpanContext<M, Eval>;
+
 	GMatrix fLocalMatrix;
-	GMatrix fCTM;
-	std::vector<GColor> colorsArr;
-	GShader::TileMode tile;
+	Eval fEval;
+};
+
+/* t goes from 0 at startAngle to 1 at endAngle, the angle measured from +x towards +y */
+class my_sweepGradient : public my_gradientBase {
+public:
+	my_sweepGradient(GPoint center, float startAngle, float endAngle, const GColor colors[], int count, GShader::TileMode tileMode)
+		: my_gradientBase(colors, count, tileMode), fLocalMatrix(GMatrix::Translate(center.x(), center.y())) {
+		const float turn = 2 * M_PI;
+		fEval.start = startAngle / turn;
+		fEval.invRange = turn / (endAngle - startAngle);
+	}
+
+	std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+		GMatrix inverse;
+		if (!(ctm * fLocalMatrix).invert(&inverse)) {
+			return nullptr;
+		}
+		return makeTiled<SweepContext>(fLocalMatrix, inverse, fEval);
+	}
+
+private:
+	struct Eval {
+		float start;        // in turns
+		float invRange;     // 1 / (end - start), in turns
+
+		/* no range at all gives 0 * inf along the start angle */
+		bool everywhere() const {
+			return std::isfinite(invRange);
+		}
+
+		F4 operator()(F4 x, F4 y) const {
+			return (turns4(y, x) - splat4(start)) * splat4(invRange);
+		}
+	};
+
+	template <TileMode M>
+	using SweepContext = SpanContext<M, Eval>;
+
+	GMatrix fLocalMatrix;
+	Eval fEval;
 };
 
 
@@ -117,4 +585,25 @@ std::unique_ptr<GShader> GCreateLinearGradient(GPoint p0, GPoint p1, const GColo
 		return nullptr;
 	}
 	return std::unique_ptr<GShader>(new my_gradient(p0, p1, colors, count, tile));
-}
\ No newline at end of file
+}
+
+std::unique_ptr<GShader> GCreateRadialGradient(GPoint center, float radius, const GColor colors[], int count, GShader::TileMode tile) {
+	if (count < 1 || !(radius > 0)) {
+		return nullptr;
+	}
+	return std::unique_ptr<GShader>(new my_radialGradient(center, radius, colors, count, tile));
+}
+
+std::unique_ptr<GShader> GCreateTwoPointConicalGradient(GPoint c0, float r0, GPoint c1, float r1, const GColor colors[], int count, GShader::TileMode tile) {
+	if (count < 1 || !(r0 >= 0) || !(r1 >= 0) || (c0.x() == c1.x() && c0.y() == c1.y() && r0 == r1)) {
+		return nullptr;
+	}
+	return std::unique_ptr<GShader>(new my_conicalGradient(c0, r0, c1, r1, colors, count, tile));
+}
+
+std::unique_ptr<GShader> GCreateSweepGradient(GPoint center, float startAngle, float endAngle, const GColor colors[], int count, GShader::TileMode tile) {
+	if (count < 1 || !(startAngle != endAngle) || !std::isfinite(endAngle - startAngle)) {
+		return nullptr;
+	}
+	return std::unique_ptr<GShader>(new my_sweepGradient(center, startAngle, endAngle, colors, count, tile));
+}
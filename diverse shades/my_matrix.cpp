@@ -1,3 +1,7 @@
+#if defined(__SSE2__)
+    #include <immintrin.h>
+#endif
+
 #include "GMath.h"
 
 #include "GMatrix.h"
@@ -78,7 +82,23 @@ bool GMatrix::invert(GMatrix* inverse) const {
  *  matrix.mapPoints(pts, pts, count);
  */
 void GMatrix::mapPoints(GPoint dst[], const GPoint src[], int count) const {
-    for (int i = 0; i < count; i++) {
+    int i = 0;
+#if defined(__SSE2__)
+    /*
+     *  2 points at a time, as x0 y0 x1 y1: x' lanes take a * x + b * y, and y' lanes take
+     *  e * y + d * x from the same products with x and y swapped, which adds up to exactly what
+     *  the loop below gets. Both points are loaded before either is stored, so dst can be src.
+     */
+    const __m128 ae = _mm_setr_ps(fMat[0], fMat[4], fMat[0], fMat[4]);
+    const __m128 bd = _mm_setr_ps(fMat[1], fMat[3], fMat[1], fMat[3]);
+    const __m128 cf = _mm_setr_ps(fMat[2], fMat[5], fMat[2], fMat[5]);
+    for (; i + 2 <= count; i += 2) {
+        const __m128 xy = _mm_loadu_ps(&src[i].fX);
+        const __m128 yx = _mm_shuffle_ps(xy, xy, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_ps(&dst[i].fX, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ae, xy), _mm_mul_ps(bd, yx)), cf));
+    }
+#endif
+    for (; i < count; i++) {
 
         float x0 = src[i].x();
         float y0 = src[i].y();
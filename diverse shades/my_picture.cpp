@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "GCanvas.h"
+#include "GMatrix.h"
+#include "GPaint.h"
+#include "GPicture.h"
+#include "GRect.h"
+
+#include "drawCommand.h"
+
+struct PictureOp {
+    enum Type { kSave, kRestore, kConcat, kDraw };
+
+    Type type;
+    GMatrix matrix;     // kConcat
+    int draw;           // kDraw, index into the draws
+    bool dead;          // set by the optimizer, then swept out
+};
+
+class my_picture : public GPicture {
+public:
+    my_picture(std::vector<PictureOp>& ops, std::vector<DrawCommand>& draws, int recordedOps)
+        : fRecordedOps(recordedOps) {
+        fOps.swap(ops);
+        fDraws.swap(draws);
+    }
+
+    void playback(GCanvas* canvas) const override {
+        canvas->save();
+        for (const PictureOp& op : fOps) {
+            switch (op.type) {
+                case PictureOp::kSave:
+                    canvas->save();
+                    break;
+                case PictureOp::kRestore:
+                    canvas->restore();
+                    break;
+                case PictureOp::kConcat:
+                    canvas->concat(op.matrix);
+                    break;
+                case PictureOp::kDraw:
+                    fDraws[op.draw].draw(canvas);
+                    break;
+            }
+        }
+        canvas->restore();
+    }
+
+    int opCount() const override {
+        return (int)fOps.size();
+    }
+
+    int recordedOpCount() const override {
+        return fRecordedOps;
+    }
+
+private:
+    std::vector<PictureOp> fOps;
+    std::vector<DrawCommand> fDraws;
+    int fRecordedOps;
+};
+
+/* The box around r after mapping it by m, false if it doesn't map to finite values */
+static bool mapBounds(const GMatrix& m, const GRect& r, GRect* dst) {
+    GPoint pts[4] = {
+        { r.fLeft, r.fTop }, { r.fRight, r.fTop }, { r.fRight, r.fBottom }, { r.fLeft, r.fBottom },
+    };
+    m.mapPoints(pts, pts, 4);
+    float l = pts[0].fX, t = pts[0].fY, rt = pts[0].fX, b = pts[0].fY;
+    for (int i = 1; i < 4; i++) {
+        l = std::min(l, pts[i].fX);
+        t = std::min(t, pts[i].fY);
+        rt = std::max(rt, pts[i].fX);
+        b = std::max(b, pts[i].fY);
+    }
+    if (!std::isfinite(l) || !std::isfinite(t) || !std::isfinite(rt) || !std::isfinite(b)) {
+        return false;
+    }
+    *dst = GRect::LTRB(l, t, rt, b);
+    return true;
+}
+
+/*
+ *  Does the draw replace every pixel of its rects without looking at what was there? Shaders
+ *  are left out, since their draws are skipped when makeContext fails.
+ */
+static bool isOccluder(const DrawCommand& draw) {
+    if (draw.type != DrawCommand::kRect || draw.paint.getShader() != nullptr) {
+        return false;
+    }
+    switch (draw.paint.getBlendMode()) {
+        case GBlendMode::kClear:
+        case GBlendMode::kSrc:
+            return true;
+        case GBlendMode::kSrcOver:
+            return draw.paint.getColor().pinToUnit().a >= 1;
+        default:
+            return false;
+    }
+}
+
+static bool samePaint(const GPaint& a, const GPaint& b) {
+    const GColor& ca = a.getColor();
+    const GColor& cb = b.getColor();
+    return ca.r == cb.r && ca.g == cb.g && ca.b == cb.b && ca.a == cb.a &&
+           a.getBlendMode() == b.getBlendMode() && a.getShader() == b.getShader();
+}
+
+static bool sameMatrix(const GMatrix& a, const GMatrix& b) {
+    for (int i = 0; i < 6; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool sameRect(const GRect& a, const GRect& b) {
+    return a.fLeft == b.fLeft && a.fTop == b.fTop && a.fRight == b.fRight && a.fBottom == b.fBottom;
+}
+
+/*
+ *  Walking backwards, remember the opaque rects drawn so far and drop any draw one of them
+ *  paints over. A draw is covered if its (picture space) box fits inside the rect's box inset
+ *  by kInset, which needs the rect to still be a rect in picture space (a scale + translate
+ *  CTM), or if it is the very same rect under the very same CTM, since that rasterizes to
+ *  exactly the same pixels under any CTM playback adds.
+ */
+static void dropCoveredDraws(std::vector<PictureOp>& ops, const std::vector<DrawCommand>& draws) {
+    enum { kMaxOccluders = 16 };
+    const float kInset = 0.5f;
+
+    struct Occluder {
+        GRect local;
+        GMatrix ctm;
+        GRect box;      // picture space, already inset
+        bool hasBox;
+        float area;
+    };
+
+    std::vector<GMatrix> ctms(ops.size());
+    std::vector<GMatrix> stack;
+    GMatrix ctm;
+    for (size_t i = 0; i < ops.size(); i++) {
+        switch (ops[i].type) {
+            case PictureOp::kSave:
+                stack.push_back(ctm);
+                break;
+            case PictureOp::kRestore:
+                ctm = stack.back();
+                stack.pop_back();
+                break;
+            case PictureOp::kConcat:
+                ctm = ctm * ops[i].matrix;
+                break;
+            case PictureOp::kDraw:
+                break;
+        }
+        ctms[i] = ctm;
+    }
+
+    std::vector<Occluder> occluders;
+    for (int i = (int)ops.size() - 1; i >= 0; i--) {
+        if (ops[i].type != PictureOp::kDraw) {
+            continue;
+        }
+        const DrawCommand& draw = draws[ops[i].draw];
+        const GMatrix& m = ctms[i];
+
+        GRect local, box;
+        const bool hasBox = draw.bounds(&local) && mapBounds(m, local, &box);
+        for (const Occluder& o : occluders) {
+            if (o.hasBox && hasBox && o.box.fLeft <= box.fLeft && o.box.fTop <= box.fTop &&
+                box.fRight <= o.box.fRight && box.fBottom <= o.box.fBottom) {
+                ops[i].dead = true;
+                break;
+            }
+            if (draw.type == DrawCommand::kRect && draw.rects.size() == 1 &&
+                sameRect(draw.rects[0], o.local) && sameMatrix(m, o.ctm)) {
+                ops[i].dead = true;
+                break;
+            }
+        }
+        if (ops[i].dead || !isOccluder(draw)) {
+            continue;
+        }
+
+        const bool axisAligned = m[GMatrix::KX] == 0 && m[GMatrix::KY] == 0;
+        for (const GRect& rect : draw.rects) {
+            Occluder o;
+            o.local = rect;
+            o.ctm = m;
+            if (!mapBounds(m, rect, &o.box)) {
+                continue;
+            }
+            o.area = o.box.width() * o.box.height();
+            o.box = GRect::LTRB(o.box.fLeft + kInset, o.box.fTop + kInset,
+                                o.box.fRight - kInset, o.box.fBottom - kInset);
+            o.hasBox = axisAligned && o.box.fLeft < o.box.fRight && o.box.fTop < o.box.fBottom;
+
+            /* keep the biggest ones */
+            if (occluders.size() < kMaxOccluders) {
+                occluders.push_back(o);
+                continue;
+            }
+            size_t smallest = 0;
+            for (size_t j = 1; j < occluders.size(); j++) {
+                if (occluders[j].area < occluders[smallest].area) {
+                    smallest = j;
+                }
+            }
+            if (o.area > occluders[smallest].area) {
+                occluders[smallest] = o;
+            }
+        }
+    }
+}
+
+/*
+ *  A save/restore pair with no draws inside goes away along with everything in it, and one
+ *  with draws but no concat at its own level only loses the save and restore. Concats after
+ *  the last draw are dropped too, playback() restores the CTM anyway.
+ */
+static void foldSaveRestore(std::vector<PictureOp>& ops) {
+    struct Frame {
+        int save;
+        bool concat;
+        bool draw;
+    };
+    std::vector<Frame> frames;
+    frames.push_back({ -1, false, false });
+
+    for (int i = 0; i < (int)ops.size(); i++) {
+        if (ops[i].dead) {
+            continue;
+        }
+        switch (ops[i].type) {
+            case PictureOp::kSave:
+                frames.push_back({ i, false, false });
+                break;
+            case PictureOp::kConcat:
+                frames.back().concat = true;
+                break;
+            case PictureOp::kDraw:
+                frames.back().draw = true;
+                break;
+            case PictureOp::kRestore: {
+                Frame f = frames.back();
+                frames.pop_back();
+                if (!f.draw) {
+                    for (int j = f.save; j <= i; j++) {
+                        ops[j].dead = true;
+                    }
+                }
+                else {
+                    if (!f.concat) {
+                        ops[f.save].dead = true;
+                        ops[i].dead = true;
+                    }
+                    frames.back().draw = true;
+                }
+                break;
+            }
+        }
+    }
+
+    for (int i = (int)ops.size() - 1; i >= 0; i--) {
+        if (ops[i].type == PictureOp::kConcat) {
+            ops[i].dead = true;
+        }
+        else if (!ops[i].dead) {
+            break;
+        }
+    }
+}
+
+/* Back to back rects with the same paint (so the same CTM too) become one op */
+static void mergeRects(std::vector<PictureOp>& ops, std::vector<DrawCommand>& draws) {
+    int prev = -1;
+    for (int i = 0; i < (int)ops.size(); i++) {
+        if (ops[i].dead) {
+            continue;
+        }
+        if (ops[i].type != PictureOp::kDraw || draws[ops[i].draw].type != DrawCommand::kRect) {
+            prev = -1;
+            continue;
+        }
+        DrawCommand& draw = draws[ops[i].draw];
+        if (prev >= 0 && samePaint(draws[prev].paint, draw.paint)) {
+            draws[prev].rects.insert(draws[prev].rects.end(), draw.rects.begin(), draw.rects.end());
+            ops[i].dead = true;
+        }
+        else {
+            prev = ops[i].draw;
+        }
+    }
+}
+
+class my_recordingCanvas : public GRecordingCanvas {
+public:
+    void save() override {
+        push(PictureOp::kSave);
+        fDepth++;
+    }
+
+    void restore() override {
+        if (fDepth == 0) {
+            return;
+        }
+        push(PictureOp::kRestore);
+        fDepth--;
+    }
+
+    void concat(const GMatrix& matrix) override {
+        push(PictureOp::kConcat).matrix = matrix;
+    }
+
+    void drawPaint(const GPaint& paint) override {
+        record(paint).type = DrawCommand::kPaint;
+    }
+
+    void drawRect(const GRect& rect, const GPaint& paint) override {
+        record(paint).setRect(rect);
+    }
+
+    void drawConvexPolygon(const GPoint points[], int count, const GPaint& paint) override {
+        if (count < 0) {
+            return;
+        }
+        record(paint).setPolygon(points, count);
+    }
+
+    void drawPath(const GPath& path, const GPaint& paint) override {
+        record(paint).setPath(path);
+    }
+
+    void drawMesh(const GPoint verts[], const GColor colors[], const GPoint texs[], int count, const int indices[], const GPaint& paint) override {
+        record(paint).setMesh(verts, colors, texs, count, indices);
+    }
+
+    void drawQuad(const GPoint verts[4], const GColor colors[4], const GPoint texs[4], int level, const GPaint& paint) override {
+        record(paint).setQuad(verts, colors, texs, level);
+    }
+
+    std::unique_ptr<GPicture> finishRecording() override {
+        while (fDepth > 0) {
+            restore();
+        }
+        const int recordedOps = (int)fOps.size();
+
+        dropCoveredDraws(fOps, fDraws);
+        foldSaveRestore(fOps);
+        mergeRects(fOps, fDraws);
+
+        /* sweep out the dead ops, and the draws only they used */
+        std::vector<PictureOp> ops;
+        std::vector<DrawCommand> draws;
+        for (PictureOp& op : fOps) {
+            if (op.dead) {
+                continue;
+            }
+            if (op.type == PictureOp::kDraw) {
+                draws.push_back(std::move(fDraws[op.draw]));
+                op.draw = (int)draws.size() - 1;
+            }
+            ops.push_back(op);
+        }
+        fOps.clear();
+        fDraws.clear();
+        return std::unique_ptr<GPicture>(new my_picture(ops, draws, recordedOps));
+    }
+
+private:
+    PictureOp& push(PictureOp::Type type) {
+        PictureOp op;
+        op.type = type;
+        op.draw = -1;
+        op.dead = false;
+        fOps.push_back(op);
+        return fOps.back();
+    }
+
+    DrawCommand& record(const GPaint& paint) {
+        push(PictureOp::kDraw).draw = (int)fDraws.size();
+        fDraws.emplace_back();
+        fDraws.back().paint = paint;
+        return fDraws.back();
+    }
+
+    std::vector<PictureOp> fOps;
+    std::vector<DrawCommand> fDraws;
+    int fDepth = 0;
+};
+
+std::unique_ptr<GRecordingCanvas> GCreateRecordingCanvas() {
+    return std::unique_ptr<GRecordingCanvas>(new my_recordingCanvas);
+}
@@ -4,6 +4,7 @@
 #include "GBitmap.h"
 #include "GMatrix.h"
 #include "GShader.h"
+#include "pipeline.h"
 
 class my_proxyShader : public GShader {
 public:
@@ -11,26 +12,59 @@ public:
     }
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
-    bool isOpaque() override {
+    bool isOpaque() const override {
         return frs->isOpaque();
     }
 
-    // The draw calls in GCanvas must call this with the CTM before any calls to shadeSpan().
-    bool setContext(const GMatrix& ctm) override {
-        return frs->setContext(ctm * transform);
+    /* the real shader's context does all the work, just under the extra transform */
+    std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+        std::unique_ptr<Context> context = frs->makeContext(ctm * transform);
+        if (!context) {
+            return nullptr;
+        }
+        return std::unique_ptr<Context>(new ProxyContext(std::move(context), transform));
     }
 
-    /**
-     *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
-     *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
-     *  can hold at least [count] entries.
-     */
-    void shadeRow(int x, int y, int count, GPixel row[]) override {
-        frs->shadeRow(x, y, count, row);
+    bool appendStages(Pipeline* pipeline, const GMatrix& ctm) const override {
+        pipeline->pushLocal(transform);
+        const bool appended = frs->appendStages(pipeline, ctm * transform);
+        pipeline->popLocal();
+        return appended;
     }
 
 
 private:
+    /* only here so setCTM can add the transform too */
+    class ProxyContext : public Context {
+    public:
+        ProxyContext(std::unique_ptr<Context> context, const GMatrix& transform)
+            : fContext(std::move(context)), fTransform(transform) {}
+
+        void shadeRow(int x, int y, int count, GPixel row[]) override {
+            fContext->shadeRow(x, y, count, row);
+        }
+
+        void shadeSpan(int start, int x, int y, int count, GPixel row[]) override {
+            fContext->shadeSpan(start, x, y, count, row);
+        }
+
+        Kind kind() const override {
+            return fContext->kind();
+        }
+
+        bool setCTM(const GMatrix& ctm) override {
+            return fContext->setCTM(ctm * fTransform);
+        }
+
+        bool canOutliveShader() const override {
+            return fContext->canOutliveShader();
+        }
+
+    private:
+        std::unique_ptr<Context> fContext;
+        const GMatrix fTransform;
+    };
+
     GShader* frs;
     GMatrix transform;
 };
@@ -1,97 +1,515 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
 #include "GBitmap.h"
 #include "GMatrix.h"
 #include "GShader.h"
+#include "mipmap.h"
+#include "pipeline.h"
+#include "spans.h"
 
 class my_shader : public GShader {
 public:
-    my_shader(const GBitmap& bitmap, const GMatrix& matrix, GShader::TileMode tileMode) : fSourceBitmap(bitmap), fLocalMatrix(matrix), tile(tileMode) {
-        rctm = GMatrix();
+    my_shader(const GBitmap& bitmap, const GMatrix& matrix, GShader::TileMode tileMode, GShader::FilterQuality quality) : fSourceBitmap(bitmap), fLocalMatrix(matrix), tile(tileMode), quality(quality) {
     }
 
     // Return true iff all of the GPixels that may be returned by this shader will be opaque.
-    bool isOpaque() override {
+    bool isOpaque() const override {
         return fSourceBitmap.isOpaque();
     }
 
-    // The draw calls in GCanvas must call this with the CTM before any calls to shadeSpan().
-    bool setContext(const GMatrix& ctm) override {
-        return (ctm * fLocalMatrix).invert(&rctm);
+    std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+        GMatrix rctm;
+        if (!(ctm * fLocalMatrix).invert(&rctm)) {
+            return nullptr;
+        }
+        switch (quality) {
+            case kBilinear:
+                return makeFilterContext<2>(rctm);
+            case kBicubic:
+                return makeFilterContext<4>(rctm);
+            default:
+                break;
+        }
+        /* nearest always samples the bitmap itself */
+        switch (tile) {
+            case TileMode::kRepeat:
+                return std::unique_ptr<Context>(new BitmapContext<TileMode::kRepeat>(this, fSourceBitmap, rctm));
+            case TileMode::kMirror:
+                return std::unique_ptr<Context>(new BitmapContext<TileMode::kMirror>(this, fSourceBitmap, rctm));
+            default:
+                return std::unique_ptr<Context>(new BitmapContext<TileMode::kClamp>(this, fSourceBitmap, rctm));
+        }
     }
 
-    /**
-     *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
-     *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
-     *  can hold at least [count] entries.
+    /* Nearest only: seed_coords, matrix, tile and gather give exactly what BitmapContext does */
+    bool appendStages(Pipeline* pipeline, const GMatrix& ctm) const override {
+        GMatrix rctm;
+        if (quality != kNearest || !(ctm * fLocalMatrix).invert(&rctm)) {
+            return false;
+        }
+        /* with no y skew fy is the same for the whole row (d * px is +-0), as in BitmapContext */
+        BitmapStage* stage = pipeline->make<BitmapStage>(BitmapStage{ fSourceBitmap, fLocalMatrix, nullptr, rctm[GMatrix::KY] == 0 });
+        pipeline->appendSeedCoords();
+        stage->inverse = pipeline->appendMatrix(rctm);
+        switch (tile) {
+            case TileMode::kRepeat:
+                pipeline->append(tileCoords<TileMode::kRepeat>, stage);
+                break;
+            case TileMode::kMirror:
+                pipeline->append(tileCoords<TileMode::kMirror>, stage);
+                break;
+            default:
+                pipeline->append(tileCoords<TileMode::kClamp>, stage);
+                break;
+        }
+        pipeline->append(gather, stage);
+        pipeline->appendUpdate(updateStage, stage);
+        pipeline->noteRead(&stage->bitmap);
+        return true;
+    }
+
+    /*
+     *  Same result as stepping val by canvas until it lands in [0, canvas), in O(1): each of
+     *  those steps is exact except the last one, which rounds the same as the one conversion
+     *  from double here does. The loops after it only catch that rounding up to canvas.
      */
-    void shadeRow(int x, int y, int count, GPixel row[]) override {
-
-        for (int i = 0; i < count; i++) {
-            GPoint point = { x + 0.5 + i, y + 0.5 };
-            GPoint lm = rctm * point;
-            int srcX = lm.fX;
-            int srcY = lm.fY;
-
-            switch (tile) {
-                case TileMode::kClamp: {
-                    // clamp x and y, min of width/height and x, y and max of 0
-                    srcX = std::max(0, std::min(fSourceBitmap.width() - 1, srcX));
-                    srcY = std::max(0, std::min(fSourceBitmap.height() - 1, srcY));
-                    break;
-                }
-                case TileMode::kRepeat: {
-                    // repeat x and y
-                    srcX = repeat(lm.fX, fSourceBitmap.width());
-                    srcY = repeat(lm.fY, fSourceBitmap.height());
-                    break;
-                }
-                case TileMode::kMirror: {
-                    //mirror then clamp
-                    srcX = std::max(0, std::min(fSourceBitmap.width() - 1, mirror(lm.fX, fSourceBitmap.width())));
-                    srcY = std::max(0, std::min(fSourceBitmap.height() - 1, mirror(lm.fY, fSourceBitmap.height())));
-                    break;
+    static int repeat(float val, int canvas) {
+        if (val < 0 || val >= canvas) {
+            double k = floor((double)val / canvas);
+            val = (float)((double)val - k * canvas);
+            while (val < 0) {
+                val += canvas;
+            }
+            while (val >= canvas) {
+                val -= canvas;
+            }
+        }
+        return GFloorToInt(val);
+    }
+
+    /*
+     *  Folds |val| into [0, canvas]: even tiles count up from 0 and odd ones down from canvas,
+     *  which tileIndex clamps to canvas - 1. Below 2^24 one double floor over the two-tile
+     *  period does it. Past that every float is whole and the tile's parity comes from the
+     *  float quotient, which can round into the next tile there, as it always has.
+     */
+    static int mirror(float val, int canvas) {
+        double v = fabs((double)val);
+        if (v < (1 << 24)) {
+            double period = 2.0 * canvas;
+            int x = (int)(v - floor(v / period) * period);
+            return x < canvas ? x : 2 * canvas - x;
+        }
+        int x = (int)fmod(v, canvas);
+        if (fmod(floorf((float)v / canvas), 2) == 0) {
+            return x;
+        }
+        return canvas - x;
+    }
+
+    /* Maps one coordinate into [0, size). M is a constant, so only one case is compiled in. */
+    template <TileMode M>
+    static int tileIndex(float val, int size) {
+        switch (M) {
+            case TileMode::kClamp:
+                // clamp x and y, min of width/height and x, y and max of 0 (truncating like (int))
+                val = std::max(-1.0f, std::min(val, (float)size));
+                return std::max(0, std::min(size - 1, (int)val));
+            case TileMode::kRepeat:
+                return repeat(val, size);
+            case TileMode::kMirror:
+                //mirror then clamp
+                return std::max(0, std::min(size - 1, mirror(val, size)));
+        }
+        return 0;
+    }
+
+    /* Maps a whole pixel index into [0, size) for a tile mode, for the filtered contexts */
+    template <TileMode M>
+    static int tileInt(int i, int size) {
+        switch (M) {
+            case TileMode::kClamp:
+                return std::max(0, std::min(size - 1, i));
+            case TileMode::kRepeat:
+                i %= size;
+                return i < 0 ? i + size : i;
+            case TileMode::kMirror:
+                i %= 2 * size;
+                if (i < 0) {
+                    i += 2 * size;
                 }
+                return i < size ? i : 2 * size - 1 - i;
+        }
+        return 0;
+    }
+
+private:
+    struct BitmapStage {
+        GBitmap bitmap;
+        GMatrix localMatrix;
+        GMatrix* inverse;   // the matrix stage's, device points to bitmap points
+        bool sameRow;       // every pixel of a device row reads the same bitmap row, iy[0]
+    };
+
+    static bool updateStage(void* ctx, const GMatrix& ctm) {
+        BitmapStage& stage = *static_cast<BitmapStage*>(ctx);
+        if (!(ctm * stage.localMatrix).invert(stage.inverse)) {
+            return false;
+        }
+        stage.sameRow = (*stage.inverse)[GMatrix::KY] == 0;
+        return true;
+    }
+
+    /* ix, iy = the bitmap pixel each of fx, fy lands on */
+    template <TileMode M>
+    static void tileCoords(Pipeline::Regs& r, void* ctx) {
+        const BitmapStage& stage = *static_cast<const BitmapStage*>(ctx);
+        const int w = stage.bitmap.width();
+        const int h = stage.bitmap.height();
+        for (int i = 0; i < r.count; i++) {
+            r.ix[i] = tileIndex<M>(r.fx[i], w);
+        }
+        if (stage.sameRow) {
+            r.iy[0] = tileIndex<M>(r.fy[0], h);
+            return;
+        }
+        for (int i = 0; i < r.count; i++) {
+            r.iy[i] = tileIndex<M>(r.fy[i], h);
+        }
+    }
+
+    /* color = the bitmap's pixels at ix, iy */
+    static void gather(Pipeline::Regs& r, void* ctx) {
+        const BitmapStage& stage = *static_cast<const BitmapStage*>(ctx);
+        if (stage.sameRow) {
+            const GPixel* src = stage.bitmap.getAddr(0, r.iy[0]);
+            for (int i = 0; i < r.count; i++) {
+                r.color[i] = src[r.ix[i]];
             }
-            row[i] = *fSourceBitmap.getAddr(srcX, srcY);
+            return;
+        }
+        for (int i = 0; i < r.count; i++) {
+            r.color[i] = *stage.bitmap.getAddr(r.ix[i], r.iy[i]);
         }
     }
 
-    int repeat(float val, int canvas) {
-        while (val < 0) {
-            val += canvas;
+    enum {
+        kFracBits = 7,                  // sample positions are snapped to 1/128 of a pixel
+        kFracOne = 1 << kFracBits,
+    };
+
+    /*
+     *  Mitchell-Netravali (B = C = 1/3) weights of the 4 pixels around a sample point for each
+     *  of its kFracOne positions between pixels 1 and 2, in kFracBits fixed point. Each set is
+     *  nudged to add up to exactly kFracOne.
+     */
+    struct MitchellTable {
+        int16_t w[kFracOne][4];
+
+        MitchellTable() {
+            for (int f = 0; f < kFracOne; f++) {
+                const float t = (float)f / kFracOne;
+                const float dist[4] = { 1 + t, t, 1 - t, 2 - t };
+                int sum = 0;
+                for (int i = 0; i < 4; i++) {
+                    w[f][i] = (int16_t)GRoundToInt(mitchell(dist[i]) * kFracOne);
+                    sum += w[f][i];
+                }
+                w[f][t < 0.5f ? 1 : 2] += kFracOne - sum;
+            }
         }
-        while (val >= canvas) {
-            val -= canvas;
+
+        static float mitchell(float x) {
+            const float B = 1 / 3.0f, C = 1 / 3.0f;
+            if (x < 1) {
+                return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x +
+                        (6 - 2 * B)) / 6;
+            }
+            return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x +
+                    (8 * B + 24 * C)) / 6;
         }
-        return GFloorToInt(val);
+    };
+
+    static const MitchellTable& mitchellTable() {
+        static const MitchellTable table;
+        return table;
+    }
+
+    /*
+     *  Filtered draws that shrink the bitmap by 2x or more sample the mip level that is closest
+     *  to (but not smaller than) the size they draw it at, so each of their pixels still blends
+     *  everything under it, and neighbouring pixels read neighbouring memory. The scale is how
+     *  much rctm shrinks areas, the closest a single number gets for a rotated or skewed CTM.
+     */
+    static int mipLevel(const GMatrix& rctm) {
+        const float scale = sqrtf(fabsf(rctm[GMatrix::SX] * rctm[GMatrix::SY] -
+                                        rctm[GMatrix::KX] * rctm[GMatrix::KY]));
+        return scale >= 2 ? GFloorToInt(log2f(scale)) : 0;
+    }
+
+    /* rctm for sampling bitmap (the source or one of its mip levels) instead of the source */
+    GMatrix toLevel(const GBitmap& bitmap, const GMatrix& rctm) const {
+        if (bitmap.pixels() == fSourceBitmap.pixels()) {
+            return rctm;
+        }
+        return GMatrix::Scale((float)bitmap.width() / fSourceBitmap.width(),
+                              (float)bitmap.height() / fSourceBitmap.height()) * rctm;
     }
 
-    int mirror(float val, int canvas) {
-        if(val < 0) {
-            val *= -1;
+    template <int R>
+    std::unique_ptr<Context> makeFilterContext(GMatrix rctm) const {
+        GBitmap bitmap = fSourceBitmap;
+        const int level = mipLevel(rctm);
+        std::shared_ptr<MipPyramid> mips;
+        if (level > 0) {
+            /* found per context, since the pixels may have been drawn into since the last one */
+            mips = MipPyramid::Find(fSourceBitmap);
+            {
+                std::lock_guard<std::mutex> lock(fMipsMutex);
+                fMips = mips;
+            }
+            bitmap = mips->level(level);
+            rctm = toLevel(bitmap, rctm);
         }
-        float value = val / canvas;
-        int floored = GFloorToInt(value);
-        int x = GFloorToInt(val);
-        if (floored % 2 == 0) {
-            return x % canvas;
+
+        /*
+         *  Bilinear samples that land exactly on pixel centers (e.g. a mip level drawn at its own
+         *  size) weigh one pixel by 1, so they are just a copy. Nearest tiles the same way for
+         *  clamp and repeat, but its mirror is off by one from the filtered one.
+         */
+        if (R == 2 && tile != TileMode::kMirror && rctm[GMatrix::SX] == 1 && rctm[GMatrix::SY] == 1 &&
+            rctm[GMatrix::KX] == 0 && rctm[GMatrix::KY] == 0 &&
+            rctm[GMatrix::TX] == floorf(rctm[GMatrix::TX]) && rctm[GMatrix::TY] == floorf(rctm[GMatrix::TY])) {
+            /* no owner: a new CTM may need the filter again, so this copy can't follow one */
+            if (tile == TileMode::kRepeat) {
+                return std::unique_ptr<Context>(new BitmapContext<TileMode::kRepeat>(nullptr, bitmap, rctm, mips));
+            }
+            return std::unique_ptr<Context>(new BitmapContext<TileMode::kClamp>(nullptr, bitmap, rctm, mips));
         }
-        else {
-            return canvas - (x % canvas);
+
+        switch (tile) {
+            case TileMode::kRepeat:
+                return std::unique_ptr<Context>(new FilterContext<TileMode::kRepeat, R>(this, level, bitmap, rctm, mips));
+            case TileMode::kMirror:
+                return std::unique_ptr<Context>(new FilterContext<TileMode::kMirror, R>(this, level, bitmap, rctm, mips));
+            default:
+                return std::unique_ptr<Context>(new FilterContext<TileMode::kClamp, R>(this, level, bitmap, rctm, mips));
         }
     }
 
-private:
+    /*
+     *  Blends the R x R bitmap pixels around each sample point (R = 2 is bilinear, R = 4 is
+     *  bicubic). The sample point is mapped the same way BitmapContext maps it, then moved
+     *  half a pixel so that pixel centers land on whole numbers. Looking up the taps (and
+     *  tiling them) is done here a chunk of pixels at a time, and the weighted sums by the
+     *  SIMD kernels in filterKernels.h.
+     */
+    template <TileMode M, int R>
+    class FilterContext : public Context {
+    public:
+        FilterContext(const my_shader* owner, int level, const GBitmap& bitmap, const GMatrix& rctm,
+                      std::shared_ptr<MipPyramid> mips)
+            : fOwner(owner), fLevel(level), fBitmap(bitmap), rctm(rctm), fMips(mips),
+              fMitchell(R == 4 ? &mitchellTable() : nullptr) {
+            const SpanProcs& procs = getSpanProcs();
+            fProc = R == 4 ? procs.bicubic : procs.bilerp;
+        }
+
+        /* as long as the new CTM wants the same mip level */
+        bool setCTM(const GMatrix& ctm) override {
+            GMatrix inverse;
+            if (!(ctm * fOwner->fLocalMatrix).invert(&inverse) || mipLevel(inverse) != fLevel) {
+                return false;
+            }
+            rctm = fOwner->toLevel(fBitmap, inverse);
+            return true;
+        }
+
+        /* px only takes exact steps, so starting at x lands on the same points */
+        void shadeSpan(int start, int x, int y, int count, GPixel row[]) override {
+            shadeRow(x, y, count, row);
+        }
+
+        void shadeRow(int x, int y, int count, GPixel row[]) override {
+            enum { K = R * R, kChunk = 64 };
+            GPixel taps[kChunk * K];
+            int16_t weights[kChunk * K];
+
+            const float py = y + 0.5;
+            const float bx = rctm[GMatrix::KX] * py;
+            const float by = rctm[GMatrix::SY] * py;
+            const float a = rctm[GMatrix::SX];
+            const float c = rctm[GMatrix::TX];
+            const float d = rctm[GMatrix::KY];
+            const float f = rctm[GMatrix::TY];
+            /* with no y skew every pixel in the row uses the same R source rows */
+            const GPixel* rows[R];
+            int16_t wy[R];
+            float px = x + 0.5;
+            if (d == 0) {
+                tapsY(d * px + by + f - 0.5f, rows, wy);
+            }
+
+            while (count > 0) {
+                const int n = std::min(count, (int)kChunk);
+                for (int i = 0; i < n; i++) {
+                    if (d != 0) {
+                        tapsY(d * px + by + f - 0.5f, rows, wy);
+                    }
+                    int xs[R];
+                    int16_t wx[R];
+                    tapsX(a * px + bx + c - 0.5f, xs, wx);
+                    px += 1;
+
+                    GPixel* t = taps + i * K;
+                    int16_t* wt = weights + i * K;
+                    for (int j = 0; j < R; j++) {
+                        for (int k = 0; k < R; k++) {
+                            t[j * R + k] = rows[j][xs[k]];
+                            wt[j * R + k] = wy[j] * wx[k];
+                        }
+                    }
+                }
+                fProc(taps, weights, n, row);
+                row += n;
+                count -= n;
+            }
+        }
+
+    private:
+        /*
+         *  The R pixel indices along one axis around bitmap coordinate u (already moved half a
+         *  pixel), tiled into [0, size), and their weights. u is snapped to kFracOne steps;
+         *  past +-2^22 that would overflow, and floats have no fraction left there anyway.
+         */
+        void taps1D(float u, int size, int idx[R], int16_t w[R]) const {
+            const float kLimit = 1 << 22;
+            u = std::max(-kLimit, std::min(u * kFracOne, kLimit * kFracOne)) + 0.5f;
+            /* GRoundToInt without the call to floorf */
+            int fu = (int)u;
+            fu -= u < fu;
+            weigh(fu & (kFracOne - 1), w);
+
+            /* index 0 of the R is (R / 2 - 1) before the one at or before u */
+            const int i0 = (fu >> kFracBits) - (R / 2 - 1);
+            const bool inside = i0 >= 0 && i0 <= size - R;
+            for (int k = 0; k < R; k++) {
+                idx[k] = inside ? i0 + k : tileInt<M>(i0 + k, size);
+            }
+        }
+
+        void tapsX(float u, int xs[R], int16_t wx[R]) const {
+            taps1D(u, fBitmap.width(), xs, wx);
+        }
+
+        void tapsY(float v, const GPixel* rows[R], int16_t wy[R]) const {
+            int ys[R];
+            taps1D(v, fBitmap.height(), ys, wy);
+            for (int j = 0; j < R; j++) {
+                rows[j] = fBitmap.getAddr(0, ys[j]);
+            }
+        }
+
+        void weigh(int frac, int16_t w[R]) const {
+            if (R == 2) {
+                w[0] = kFracOne - frac;
+                w[1] = frac;
+            }
+            else {
+                for (int i = 0; i < R; i++) {
+                    w[i] = fMitchell->w[frac][i];
+                }
+            }
+        }
+
+        const my_shader* fOwner;
+        const int fLevel;                           // the mip level rctm asked for
+        const GBitmap fBitmap;
+        GMatrix rctm;
+        const std::shared_ptr<MipPyramid> fMips;    // owns fBitmap's pixels when it is a mip level
+        const MitchellTable* fMitchell;
+        filterRowProc fProc;
+    };
+
+    /*
+     *  rctm (the inverse of CTM * local matrix) takes device points back to bitmap points.
+     *  Each pixel still gets its own (a * x + b * y) + c, in that order, so it rounds exactly
+     *  as GMatrix::mapPoints did; only the parts that don't change along the row are hoisted.
+     *  The tile mode is a template parameter so the inner loop doesn't branch on it.
+     */
+    template <TileMode M>
+    class BitmapContext : public Context {
+    public:
+        BitmapContext(const my_shader* owner, const GBitmap& bitmap, const GMatrix& rctm,
+                      std::shared_ptr<MipPyramid> mips = nullptr)
+            : fOwner(owner), fBitmap(bitmap), rctm(rctm), fMips(mips) {}
+
+        bool setCTM(const GMatrix& ctm) override {
+            return fOwner != nullptr && (ctm * fOwner->fLocalMatrix).invert(&rctm);
+        }
+
+        /* as in FilterContext, px only takes exact steps */
+        void shadeSpan(int start, int x, int y, int count, GPixel row[]) override {
+            shadeRow(x, y, count, row);
+        }
+
+        void shadeRow(int x, int y, int count, GPixel row[]) override {
+            const int w = fBitmap.width();
+            const int h = fBitmap.height();
+            const float py = y + 0.5;
+            const float bx = rctm[GMatrix::KX] * py;
+            const float by = rctm[GMatrix::SY] * py;
+            const float a = rctm[GMatrix::SX];
+            const float c = rctm[GMatrix::TX];
+            const float d = rctm[GMatrix::KY];
+            const float f = rctm[GMatrix::TY];
+
+            /* pixel centers stay exact in float as long as the row does (|x| < 2^22) */
+            float px = x + 0.5;
+
+            if (d == 0) {
+                /* d * px is +-0 for every pixel, so the whole row reads one bitmap row */
+                const GPixel* src = fBitmap.getAddr(0, tileIndex<M>(d * px + by + f, h));
+                for (int i = 0; i < count; i++) {
+                    row[i] = src[tileIndex<M>(a * px + bx + c, w)];
+                    px += 1;
+                }
+                return;
+            }
+            for (int i = 0; i < count; i++) {
+                int srcX = tileIndex<M>(a * px + bx + c, w);
+                int srcY = tileIndex<M>(d * px + by + f, h);
+                row[i] = *fBitmap.getAddr(srcX, srcY);
+                px += 1;
+            }
+        }
+
+    private:
+        const my_shader* fOwner;                    // null when standing in for a FilterContext
+        const GBitmap fBitmap;
+        GMatrix rctm;
+        const std::shared_ptr<MipPyramid> fMips;    // owns fBitmap's pixels when it is a mip level
+    };
+
     GBitmap fSourceBitmap;
     GMatrix fLocalMatrix;
-    GMatrix rctm;
     GShader::TileMode tile;
+    GShader::FilterQuality quality;
+
+    /* the last pyramid found, held so its levels outlive the contexts that sample them */
+    mutable std::mutex fMipsMutex;
+    mutable std::shared_ptr<MipPyramid> fMips;
 };
 
 /**
- *  Return a subclass of GShader that draws the specified bitmap and the local matrix.
- *  Returns null if the either parameter is invalid.
+ *  Return a subclass of GShader that draws the specified bitmap and the local matrix, sampled
+ *  with the given filter quality. Returns null if the either parameter is invalid.
  */
-std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap& mbitmap, const GMatrix& localMatrix, GShader::TileMode tile) {
+std::unique_ptr<GShader> GCreateBitmapShader(const GBitmap& mbitmap, const GMatrix& localMatrix, GShader::TileMode tile, GShader::FilterQuality quality) {
 
-    return std::unique_ptr<GShader>(new my_shader(mbitmap, localMatrix, tile));
+    return std::unique_ptr<GShader>(new my_shader(mbitmap, localMatrix, tile, quality));
 }
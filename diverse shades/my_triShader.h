@@ -4,37 +4,82 @@
 #include "GBitmap.h"
 #include "GMatrix.h"
 #include "GShader.h"
+#include "pipeline.h"
 
-class my_triShader : public GShader {
+#if defined(__SSE2__)
+    #include <immintrin.h>
+#endif
+
+/*
+ *  The colors of one triangle: device points map to the triangle's (u, v), where the color is
+ *  c0 + u * dc1 + v * dc2. my_triShader's context, and what drawMesh resets in place for each
+ *  of a mesh's triangles.
+ */
+class TriColors : public GShader::Context {
 public:
-    my_triShader(const GPoint pts[3], const GColor colors[3]){
+    /* False if the triangle has no area under ctm */
+    bool set(const GPoint pts[3], const GColor colors[3], const GMatrix& ctm) {
+        GPoint u = pts[1] - pts[0];
+        GPoint v = pts[2] - pts[0];
+        fTriangle = GMatrix(u.x(), v.x(), pts[0].x(), u.y(), v.y(), pts[0].y());
         c0 = colors[0];
-        c1 = colors[1];
-        c2 = colors[2];
-        p0 = pts[0];
-        p1 = pts[1];
-        p2 = pts[2];
+        dc1 = colors[1] - colors[0];
+        dc2 = colors[2] - colors[0];
+        return setCTM(ctm);
+    }
+
+    /* The same triangle and colors, under ctm */
+    bool setCTM(const GMatrix& ctm) override {
+        fSpanValid = false;
+        if (!(ctm * fTriangle).invert(&fInv)) {
+            return false;
+        }
+        GColor diffc1 = fInv[0] * dc1;
+        GColor diffc2 = fInv[3] * dc2;
+        dc = diffc1 + diffc2;
+        return true;
+    }
 
-        GPoint u = p1 - p0;
-        GPoint v = p2 - p0;
+    void shadeRow(int x, int y, int count, GPixel row[]) override {
+        GColor c = colorAt(x, y);
+        lerpRow(&c, dc, count, row);
+    }
 
-        fInv = GMatrix();
-        fMatrix = GMatrix(u.x(), v.x(), p0.x(), u.y(), v.y(), p0.y());
+    /* set copies everything it needs */
+    bool canOutliveShader() const override {
+        return true;
+    }
 
-        dc1 = c1 - c0;
-        dc2 = c2 - c0;
+    /* the pixels before x are only stepped over, not packed */
+    void shadeSpan(int start, int x, int y, int count, GPixel row[]) override {
+        GColor c = spanColor(start, x, y);
+        lerpRow(&c, dc, count, row);
     }
 
-    // Return true iff all of the GPixels that may be returned by this shader will be opaque.
-    bool isOpaque() override {
-        return (c0.a == 1.0 && c1.a == 1.0 && c2.a == 1.0);
+    /* The pipeline's chunks of a span carry on from where the last one stopped */
+    void shadeChunk(Pipeline::Regs& r) {
+        if (r.x == r.left) {
+            fColor = spanColor(r.shadeX, r.left, r.y);
+        }
+        for (int i = 0; i < r.count; i++) {
+            r.r[i] = fColor.r;
+            r.g[i] = fColor.g;
+            r.b[i] = fColor.b;
+            r.a[i] = fColor.a;
+            fColor += dc;
+        }
     }
 
-    int floatTOpixel(float value) {
+    /* A highp stage for a TriColors ctx */
+    static void Stage(Pipeline::Regs& r, void* ctx) {
+        static_cast<TriColors*>(ctx)->shadeChunk(r);
+    }
+
+    static int floatTOpixel(float value) {
         return floor(value * 255 + 0.5);
     }
 
-    GPixel colorTOpixel(const GColor& c) {
+    static GPixel colorTOpixel(const GColor& c) {
         int a = floatTOpixel(c.a);
         int r = floatTOpixel(c.r * c.a);
         int g = floatTOpixel(c.g * c.a);
@@ -42,51 +87,148 @@ public:
         return GPixel_PackARGB(a, r, g, b);
     }
 
-
-    // The draw calls in GCanvas must call this with the CTM before any calls to shadeSpan().
-    bool setContext(const GMatrix& ctm) override {
-        fMatrix.invert(&fInv);
-
-        //fInv.setIdentity();
-
-
-        return (ctm * fMatrix).invert(&fInv);
+private:
+    GColor colorAt(int x, int y) const {
+        GPoint p = { x + 0.5f, y + 0.5f };
+        GPoint pt = fInv * p;
+        return pt.x() * dc1 + pt.y() * dc2 + c0;
     }
 
-    /**
-     *  Given a row of pixels in device space [x, y] ... [x + count - 1, y], return the
-     *  corresponding src pixels in row[0...count - 1]. The caller must ensure that row[]
-     *  can hold at least [count] entries.
+    /*
+     *  The color at x, stepped there from start like the span's pixels are. A row's parts
+     *  (its tiles, or its chunks) are shaded left to right, so this carries on from the last
+     *  call on the same span instead of stepping from start each time: the same steps, so the
+     *  same rounding.
      */
-    void shadeRow(int x, int y, int count, GPixel row[]) override {
-        GPoint p = { x + 0.5, y + 0.5 };
-        GPoint pt = fInv * p;
-
-        GColor diffc1 = fInv[0] * dc1;
-        GColor diffc2 = fInv[3] * dc2;
-
-        dc = diffc1 + diffc2;
+    GColor spanColor(int start, int x, int y) {
+        if (!fSpanValid || start != fSpanStart || y != fSpanY || x < fSpanX) {
+            fSpanValid = true;
+            fSpanStart = start;
+            fSpanY = y;
+            fSpanX = start;
+            fSpanColor = colorAt(start, y);
+        }
+        for (; fSpanX < x; fSpanX++) {
+            fSpanColor += dc;
+        }
+        return fSpanColor;
+    }
 
-        GColor c = pt.x() * dc1 + pt.y() * dc2 + c0;
+    /* row[i] is c + i * dc (stepped, not multiplied), and c is left at c + count * dc */
+    static void lerpRow(GColor* color, const GColor& dc, int count, GPixel row[]) {
+#if defined(__SSE2__)
+        /*
+         *  The same float steps and rounding as colorTOpixel, all 4 channels at once, in pixel
+         *  order (b, g, r, a). floor(v + 0.5) is floor(v) + (fraction >= 0.5), which can't
+         *  round up early the way adding 0.5 in float can.
+         */
+        __m128 cv = _mm_setr_ps(color->b, color->g, color->r, color->a);
+        const __m128 dcv = _mm_setr_ps(dc.b, dc.g, dc.r, dc.a);
+        const __m128 alphaLane = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+        for (int i = 0; i < count; i++) {
+            const __m128 a = _mm_shuffle_ps(cv, cv, _MM_SHUFFLE(3, 3, 3, 3));
+            const __m128 premul = _mm_or_ps(_mm_and_ps(alphaLane, cv), _mm_andnot_ps(alphaLane, _mm_mul_ps(cv, a)));
+            const __m128 v = _mm_mul_ps(premul, _mm_set1_ps(255));
+
+            __m128i n = _mm_cvttps_epi32(v);
+            n = _mm_add_epi32(n, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(n), v)));
+            const __m128 frac = _mm_sub_ps(v, _mm_cvtepi32_ps(n));
+            n = _mm_sub_epi32(n, _mm_castps_si128(_mm_cmpge_ps(frac, _mm_set1_ps(0.5f))));
+
+            /* b | g << 8 | r << 16 | a << 24, like GPixel_PackARGB */
+            const __m128i packed = _mm_or_si128(_mm_or_si128(n, _mm_slli_epi32(_mm_srli_si128(n, 4), 8)),
+                                                _mm_or_si128(_mm_slli_epi32(_mm_srli_si128(n, 8), 16),
+                                                             _mm_slli_epi32(_mm_srli_si128(n, 12), 24)));
+            row[i] = (GPixel)_mm_cvtsi128_si32(packed);
+            cv = _mm_add_ps(cv, dcv);
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, cv);
+        *color = GColor::RGBA(lanes[2], lanes[1], lanes[0], lanes[3]);
+#else
         for (int i = 0; i < count; i++) {
-            row[i] = colorTOpixel(c);
-            c += dc;
+            row[i] = colorTOpixel(*color);
+            *color += dc;
         }
+#endif
     }
 
-
-private:
+    GMatrix fTriangle;  // (u, v) to the triangle's points
     GMatrix fInv;
-    GMatrix fMatrix;
     GColor c0;
-    GColor c1;
-    GColor c2;
-    GPoint p0;
-    GPoint p1;
-    GPoint p2;
-    GColor dc;
     GColor dc1;
     GColor dc2;
+    GColor dc;      // color step for one pixel to the right
+    GColor fColor;  // the next pixel's color, for shadeChunk
+    /* where spanColor stopped: fSpanColor is the color at fSpanX on the span from fSpanStart */
+    bool fSpanValid = false;
+    int fSpanStart, fSpanY, fSpanX;
+    GColor fSpanColor;
+};
+
+class my_triShader : public GShader {
+public:
+    my_triShader(const GPoint pts[3], const GColor colors[3]) {
+        for (int i = 0; i < 3; i++) {
+            fPts[i] = pts[i];
+            fColors[i] = colors[i];
+        }
+    }
+
+    // Return true iff all of the GPixels that may be returned by this shader will be opaque.
+    bool isOpaque() const override {
+        return (fColors[0].a == 1.0 && fColors[1].a == 1.0 && fColors[2].a == 1.0);
+    }
+
+    std::unique_ptr<Context> makeContext(const GMatrix& ctm) const override {
+        std::unique_ptr<TriColors> context(new TriColors);
+        if (!context->set(fPts, fColors, ctm)) {
+            return nullptr;
+        }
+        return std::move(context);
+    }
+
+    /* One color is the same pixel everywhere (every step is 0), anything else is stepped in float */
+    bool appendStages(Pipeline* pipeline, const GMatrix& ctm) const override {
+        Stage* stage = pipeline->make<Stage>();
+        for (int i = 0; i < 3; i++) {
+            stage->pts[i] = fPts[i];
+            stage->colors[i] = fColors[i];
+        }
+        if (!updateStage(stage, ctm)) {
+            return false;
+        }
+        if (sameColor(fColors[0], fColors[1]) && sameColor(fColors[0], fColors[2])) {
+            pipeline->appendColor(TriColors::colorTOpixel(fColors[0]));
+        }
+        else {
+            pipeline->append(TriColors::Stage, &stage->triColors, Pipeline::kHighp);
+            pipeline->appendPack();
+        }
+        pipeline->appendUpdate(updateStage, stage);
+        return true;
+    }
+
+private:
+    /* copies the triangle, so the pipeline can outlive the shader */
+    struct Stage {
+        GPoint pts[3];
+        GColor colors[3];
+        TriColors triColors;
+    };
+
+    /* even one color needs the triangle to have an area, to draw at all */
+    static bool updateStage(void* ctx, const GMatrix& ctm) {
+        Stage& stage = *static_cast<Stage*>(ctx);
+        return stage.triColors.set(stage.pts, stage.colors, ctm);
+    }
+
+    static bool sameColor(const GColor& a, const GColor& b) {
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    }
+
+    GPoint fPts[3];
+    GColor fColors[3];
 };
 
 /**
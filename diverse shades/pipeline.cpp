@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#if defined(__SSE2__)
+    #include <immintrin.h>
+#endif
+
+#include "pipeline.h"
+#include "spans.h"
+
+Pipeline::Pipeline() : fBlock(0), fUsed(0), fContextRowsUsed(0), fPrecision(kLowp), fBlend(nullptr),
+                       fKeepsShaders(false), fRegs(new Regs) {}
+
+Pipeline::~Pipeline() {
+    reset();
+}
+
+void Pipeline::reset() {
+    /* newest first, since a ctx may point at one made before it */
+    for (size_t i = fDestructors.size(); i > 0; i--) {
+        fDestructors[i - 1].proc(fDestructors[i - 1].ptr);
+    }
+    fDestructors.clear();
+    fStages.clear();
+    fUpdates.clear();
+    fBlock = 0;
+    fUsed = 0;
+    fContextRowsUsed = 0;
+    fPrecision = kLowp;
+    fBlend = nullptr;
+    fKeepsShaders = false;
+    fReads.clear();
+}
+
+void* Pipeline::allocate(size_t size, size_t align) {
+    const size_t kBlockSize = 4096;
+    while (true) {
+        if (fBlock < fBlocks.size()) {
+            const size_t start = (fUsed + align - 1) & ~(align - 1);
+            if (start + size <= fBlockSizes[fBlock]) {
+                fUsed = start + size;
+                return fBlocks[fBlock].get() + start;
+            }
+            if (fUsed > 0) {
+                fBlock++;
+                fUsed = 0;
+                continue;
+            }
+        }
+        /* new[] is aligned for any type, and the block starts out empty */
+        const size_t blockSize = std::max(kBlockSize, size);
+        fBlocks.insert(fBlocks.begin() + fBlock, std::unique_ptr<char[]>(new char[blockSize]));
+        fBlockSizes.insert(fBlockSizes.begin() + fBlock, blockSize);
+    }
+}
+
+void Pipeline::appendUpdate(UpdateProc proc, void* ctx) {
+    fUpdates.push_back({ Update::kProc, proc, ctx, GMatrix() });
+}
+
+void Pipeline::pushLocal(const GMatrix& local) {
+    fUpdates.push_back({ Update::kPush, nullptr, nullptr, local });
+}
+
+void Pipeline::popLocal() {
+    fUpdates.push_back({ Update::kPop, nullptr, nullptr, GMatrix() });
+}
+
+bool Pipeline::update(const GMatrix& ctm) {
+    fCTMs.clear();
+    fCTMs.push_back(ctm);
+    for (const Update& u : fUpdates) {
+        switch (u.kind) {
+            case Update::kProc:
+                if (!u.proc(u.ctx, fCTMs.back())) {
+                    return false;
+                }
+                break;
+            case Update::kPush:
+                /* the same product the shader was appended with */
+                fCTMs.push_back(fCTMs.back() * u.local);
+                break;
+            case Update::kPop:
+                fCTMs.pop_back();
+                break;
+        }
+    }
+    return true;
+}
+
+void Pipeline::append(StageProc proc, void* ctx, Precision precision) {
+    fStages.push_back({ proc, ctx });
+    fPrecision = std::max(fPrecision, precision);
+}
+
+static void seedCoords(Pipeline::Regs& r, void*) {
+    /* pixel centers stay exact in float as long as the row does (|x| < 2^22) */
+    const float y = r.y + 0.5f;
+    for (int i = 0; i < r.count; i++) {
+        r.fx[i] = (float)(r.x + i) + 0.5f;
+        r.fy[i] = y;
+    }
+}
+
+void Pipeline::appendSeedCoords() {
+    append(seedCoords);
+}
+
+static void matrix(Pipeline::Regs& r, void* ctx) {
+    const GMatrix& m = *static_cast<const GMatrix*>(ctx);
+    const float a = m[GMatrix::SX], b = m[GMatrix::KX], c = m[GMatrix::TX];
+    const float d = m[GMatrix::KY], e = m[GMatrix::SY], f = m[GMatrix::TY];
+    for (int i = 0; i < r.count; i++) {
+        const float x = r.fx[i];
+        const float y = r.fy[i];
+        r.fx[i] = a * x + b * y + c;
+        r.fy[i] = d * x + e * y + f;
+    }
+}
+
+GMatrix* Pipeline::appendMatrix(const GMatrix& m) {
+    GMatrix* stage = make<GMatrix>(m);
+    append(matrix, stage);
+    return stage;
+}
+
+static void color(Pipeline::Regs& r, void* ctx) {
+    const GPixel pixel = *static_cast<const GPixel*>(ctx);
+    for (int i = 0; i < r.count; i++) {
+        r.color[i] = pixel;
+    }
+}
+
+void Pipeline::appendColor(GPixel pixel) {
+    append(color, make<GPixel>(pixel));
+}
+
+static int packChannel(float value) {
+    return floor(value * 255 + 0.5);
+}
+
+#if defined(__SSE2__)
+/*
+ *  packChannel for 4 values: floor(v * 255 + 0.5), with v * 255 in float and the rest in
+ *  double, is floor(v * 255) plus whether the fraction left is at least 0.5. Adding 0.5 in
+ *  float instead could round up early.
+ */
+static inline __m128i packChannel4(__m128 v) {
+    v = _mm_mul_ps(v, _mm_set1_ps(255));
+    __m128i n = _mm_cvttps_epi32(v);
+    n = _mm_add_epi32(n, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(n), v)));
+    const __m128 frac = _mm_sub_ps(v, _mm_cvtepi32_ps(n));
+    return _mm_sub_epi32(n, _mm_castps_si128(_mm_cmpge_ps(frac, _mm_set1_ps(0.5f))));
+}
+#endif
+
+static void pack(Pipeline::Regs& r, void*) {
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= r.count; i += 4) {
+        const __m128 a = _mm_loadu_ps(r.a + i);
+        const __m128i pa = packChannel4(a);
+        const __m128i pr = packChannel4(_mm_mul_ps(_mm_loadu_ps(r.r + i), a));
+        const __m128i pg = packChannel4(_mm_mul_ps(_mm_loadu_ps(r.g + i), a));
+        const __m128i pb = packChannel4(_mm_mul_ps(_mm_loadu_ps(r.b + i), a));
+        /* OR'd together unclamped, exactly like GPixel_PackARGB */
+        const __m128i packed = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(pa, GPIXEL_SHIFT_A), _mm_slli_epi32(pr, GPIXEL_SHIFT_R)),
+                                            _mm_or_si128(_mm_slli_epi32(pg, GPIXEL_SHIFT_G), _mm_slli_epi32(pb, GPIXEL_SHIFT_B)));
+        _mm_storeu_si128((__m128i*)(r.color + i), packed);
+    }
+#endif
+    for (; i < r.count; i++) {
+        const float a = r.a[i];
+        r.color[i] = GPixel_PackARGB(packChannel(a), packChannel(r.r[i] * a), packChannel(r.g[i] * a),
+                                     packChannel(r.b[i] * a));
+    }
+}
+
+void Pipeline::appendPack() {
+    append(pack, nullptr, kHighp);
+}
+
+static void save(Pipeline::Regs& r, void*) {
+    memcpy(r.saved, r.color, r.count * sizeof(GPixel));
+}
+
+void Pipeline::appendSave() {
+    append(save);
+}
+
+static void modulate(Pipeline::Regs& r, void* ctx) {
+    const blendRowProc proc = *static_cast<const blendRowProc*>(ctx);
+    proc(r.saved, r.color, r.count);
+}
+
+void Pipeline::appendModulate() {
+    append(modulate, make<blendRowProc>(getSpanProcs().modulate));
+}
+
+/*
+ *  A context shades the span's [left, right) on its first chunk, as part of the span from
+ *  shadeX like ShaderBlitter asks for it, since it may step its color along the row. Later
+ *  chunks copy out their part.
+ */
+struct ContextStage {
+    const GShader* shader;
+    std::unique_ptr<GShader::Context> context;
+    std::vector<GPixel>* row;   // one of the pipeline's fContextRows
+};
+
+static void shadeContext(Pipeline::Regs& r, void* ctx) {
+    ContextStage& stage = *static_cast<ContextStage*>(ctx);
+    if (r.x == r.left) {
+        stage.row->resize(r.right - r.left);
+        stage.context->shadeSpan(r.shadeX, r.left, r.y, r.right - r.left, stage.row->data());
+    }
+    memcpy(r.color, stage.row->data() + (r.x - r.left), r.count * sizeof(GPixel));
+}
+
+/* moves the context in place if it can, and only allocates a new one if it can't */
+static bool remakeContext(void* ctx, const GMatrix& ctm) {
+    ContextStage& stage = *static_cast<ContextStage*>(ctx);
+    if (stage.context != nullptr && stage.context->setCTM(ctm)) {
+        return true;
+    }
+    if (stage.context != nullptr && stage.context->canOutliveShader()) {
+        /* the shader can't draw with ctm either (see canOutliveShader), and may be gone */
+        return false;
+    }
+    stage.context = stage.shader->makeContext(ctm);
+    return stage.context != nullptr;
+}
+
+bool Pipeline::appendContext(const GShader& shader, const GMatrix& ctm) {
+    std::unique_ptr<GShader::Context> context = shader.makeContext(ctm);
+    if (!context) {
+        return false;
+    }
+    if (fContextRowsUsed == fContextRows.size()) {
+        fContextRows.emplace_back();
+    }
+    if (!context->canOutliveShader()) {
+        keepShader();
+    }
+    ContextStage* stage = make<ContextStage>();
+    stage->shader = &shader;
+    stage->context = std::move(context);
+    stage->row = &fContextRows[fContextRowsUsed++];
+    append(shadeContext, stage);
+    appendUpdate(remakeContext, stage);
+    return true;
+}
+
+static void blend(Pipeline::Regs& r, void* ctx) {
+    const blendRowProc proc = *static_cast<const blendRowProc*>(ctx);
+    proc(r.color, r.dst, r.count);
+}
+
+void Pipeline::appendBlend(blendRowProc proc) {
+    if (fBlend != nullptr) {
+        *fBlend = proc;
+        return;
+    }
+    fBlend = make<blendRowProc>(proc);
+    append(blend, fBlend);
+}
+
+void Pipeline::run(int shadeX, int left, int right, int y, GPixel dst[]) {
+    Regs& r = *fRegs;
+    r.left = left;
+    r.right = right;
+    r.y = y;
+    r.shadeX = shadeX;
+    for (r.x = left; r.x < right; r.x += r.count) {
+        r.count = std::min(right - r.x, (int)kChunk);
+        r.dst = dst + (r.x - left);
+        for (const Stage& stage : fStages) {
+            stage.proc(r, stage.ctx);
+        }
+    }
+}
@@ -0,0 +1,171 @@
+#ifndef pipeline_DEFINED
+#define pipeline_DEFINED
+
+#include <deque>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "GBitmap.h"
+#include "GMatrix.h"
+#include "GPixel.h"
+#include "GShader.h"
+#include "blendModes.h"
+
+/*
+ *  A draw's shading and blending as a list of stages, run one after another over a chunk of
+ *  pixels at a time. A composed shader becomes one loop over its stages rather than nested
+ *  virtual shadeRow calls, each with its own row buffers. Shaders add their stages with
+ *  GShader::appendStages, and the canvas adds the blend at the end and runs the whole list
+ *  once per span (see PipelineBlitter).
+ *
+ *  Stages only talk to each other through Regs. Shaders that don't have stages of their own
+ *  run through appendContext, which shades the span with their context.
+ *
+ *  Colors come in two precisions. Lowp stages work on 8 bit premultiplied pixels (color and
+ *  saved), doing their math in 16 bit lanes with the span procs, as blending always has.
+ *  Highp stages work on float r, g, b, a, for colors that are interpolated in float, and
+ *  appendPack rounds those to pixels. A pipeline is only highp if one of its stages has to be,
+ *  so shaders append the cheapest stages that give exactly their colors.
+ *
+ *  A mesh builds its pipeline once and then moves it from triangle to triangle with update,
+ *  which hands each triangle's CTM to the stages whose state came from the CTM (they register
+ *  with appendUpdate). Stage contexts come out of blocks the pipeline keeps from one draw to
+ *  the next, so once a canvas has warmed up, neither of those touches the heap.
+ *
+ *  my_tiledCanvas keeps pipelines to run after the draw call has returned, when the shader may
+ *  be gone, so a pipeline tracks whether its stages still need their shaders (keepsShaders)
+ *  and which bitmaps they sample (reads), whose pixels may be gone too.
+ */
+class Pipeline {
+public:
+    enum { kChunk = 64 };
+
+    enum Precision {
+        kLowp,
+        kHighp,
+    };
+
+    struct Regs {
+        /* the span being drawn is [left, right) of row y, this chunk is [x, x + count) of it */
+        int left, right, y;
+        int x, count;
+        /* shaders that step their color along the row start at shadeX (see ShaderBlitter) */
+        int shadeX;
+
+        float fx[kChunk], fy[kChunk];   // each pixel's point, as the stages have mapped it so far
+        int ix[kChunk], iy[kChunk];     // whole pixel coordinates, for gathers
+        GPixel color[kChunk];           // each pixel's color so far
+        GPixel saved[kChunk];           // a color put aside by appendSave
+        float r[kChunk], g[kChunk], b[kChunk], a[kChunk];   // highp color, not premultiplied
+        GPixel* dst;                    // the chunk's device pixels
+    };
+
+    typedef void (*StageProc)(Regs& regs, void* ctx);
+
+    /* Redoes ctx's CTM dependent state for ctm, or returns false if it can't draw with it */
+    typedef bool (*UpdateProc)(void* ctx, const GMatrix& ctm);
+
+    Pipeline();
+    ~Pipeline();
+
+    void reset();
+    bool empty() const { return fStages.empty(); }
+
+    /* True if the stages, and their updates, still read the shaders that appended them */
+    bool keepsShaders() const { return fKeepsShaders; }
+    /* Notes that a stage or its update reads its shader after appendStages has returned */
+    void keepShader() { fKeepsShaders = true; }
+    /* The bitmaps the stages sample, in the order they were appended */
+    const std::vector<GBitmap*>& reads() const { return fReads; }
+    /* Notes that a stage samples *bitmap, its own copy, which may be pointed at other pixels */
+    void noteRead(GBitmap* bitmap) { fReads.push_back(bitmap); }
+
+    /* kHighp once any stage is */
+    Precision precision() const { return fPrecision; }
+
+    void append(StageProc proc, void* ctx = nullptr, Precision precision = kLowp);
+
+    /* A T for a stage's ctx, which lives until the next reset */
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* value = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        fDestructors.push_back({ destroy<T>, value });
+        return value;
+    }
+
+    /* Has update call proc(ctx, ctm), with ctm times whatever pushLocal added on top of it */
+    void appendUpdate(UpdateProc proc, void* ctx);
+    /* Updates appended until the matching popLocal get ctm * local (see my_proxyShader) */
+    void pushLocal(const GMatrix& local);
+    void popLocal();
+    /* Moves the stages to a new CTM in place, false if one of them can't draw with it */
+    bool update(const GMatrix& ctm);
+
+    /* fx, fy = each pixel's center */
+    void appendSeedCoords();
+    /* fx, fy = m * (fx, fy), rounding the way GMatrix::mapPoints does. Returns the stage's
+       copy of m, for updates. */
+    GMatrix* appendMatrix(const GMatrix& m);
+    /* color = pixel */
+    void appendColor(GPixel pixel);
+    /* color = r, g, b, a premultiplied and rounded like TriColors::colorTOpixel (highp) */
+    void appendPack();
+    /* saved = color */
+    void appendSave();
+    /* color = color * saved, channel by channel (see my_compositeShader) */
+    void appendModulate();
+    /* color = what shader's context for ctm shades, or false if it has none (moved by update) */
+    bool appendContext(const GShader& shader, const GMatrix& ctm);
+    /* dst = color blended into dst with proc. A pipeline has one blend, at the end, so this
+       only changes proc once it's there, for a pipeline that several canvases draw with. */
+    void appendBlend(blendRowProc proc);
+
+    /* Runs the stages over [left, right) of row y, shaders starting from shadeX */
+    void run(int shadeX, int left, int right, int y, GPixel dst[]);
+
+private:
+    struct Stage {
+        StageProc proc;
+        void* ctx;
+    };
+
+    struct Update {
+        enum Kind { kProc, kPush, kPop } kind;
+        UpdateProc proc;
+        void* ctx;
+        GMatrix local;
+    };
+
+    struct Destructor {
+        void (*proc)(void*);
+        void* ptr;
+    };
+
+    template <typename T>
+    static void destroy(void* ptr) {
+        static_cast<T*>(ptr)->~T();
+    }
+
+    /* size bytes from the current block, moving on to the next one (or a new one) when it's full */
+    void* allocate(size_t size, size_t align);
+
+    std::vector<Stage> fStages;
+    std::vector<Update> fUpdates;
+    std::vector<GMatrix> fCTMs;     // update's stack of CTMs, kept for its capacity
+    std::vector<Destructor> fDestructors;
+    std::vector<GBitmap*> fReads;
+    std::vector<std::unique_ptr<char[]>> fBlocks;
+    std::vector<size_t> fBlockSizes;
+    size_t fBlock;                  // the block make is using
+    size_t fUsed;                   // bytes of it used so far
+    /* appendContext's rows, kept for their capacity (a deque, so growing it doesn't move them) */
+    std::deque<std::vector<GPixel>> fContextRows;
+    size_t fContextRowsUsed;
+    Precision fPrecision;
+    blendRowProc* fBlend;           // appendBlend's stage, once it has one
+    bool fKeepsShaders;
+    std::unique_ptr<Regs> fRegs;
+};
+
+#endif
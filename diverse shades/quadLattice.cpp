@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cmath>
+
+#include "quadLattice.h"
+
+static GColor findColor(const GColor colors[4], float u, float v) {
+    return (1.0f - u) * (1.0f - v) * colors[0] + u * (1.0f - v) * colors[1] + u * (v * colors[2]) + v * (1.0f - u) * colors[3];
+}
+
+static GPoint findPoint(const GPoint points[4], float u, float v) {
+    return (1.0f - u) * (1.0f - v) * points[0] + u * (1.0f - v) * points[1] + u * (v * points[2]) + v * (1.0f - u) * points[3];
+}
+
+/*
+ *  The triangles match the bilinear quad exactly except for its twist, the uv term
+ *  (p0 - p1 + p2 - p3) * u * v, which they are off by at most |twist| / (4 * n * n) with n cells
+ *  a side. So n is the fewest cells that keep that within a quarter pixel on the device (as
+ *  numQuadSegments does for curves), a quarter pixel of where the texture lands, and one step of
+ *  8 bit color, but no more than one every kMinCell pixels across the quad, so small quads stay
+ *  a few triangles.
+ */
+int QuadLattice::AutoLevel(const GMatrix& ctm, const GPoint verts[4], const GColor colors[4],
+                           const GPoint texs[4]) {
+    const float kMinCell = 4;
+    const float kMaxCells = 256;
+
+    GPoint dev[4];
+    ctm.mapPoints(dev, verts, 4);
+    const float extent = std::max((dev[2] - dev[0]).length(), (dev[3] - dev[1]).length());
+    /* false for NaN too, which drawMesh will skip anyway */
+    if (!(extent >= 0)) {
+        return 0;
+    }
+
+    float nn = (dev[0] - dev[1] + dev[2] - dev[3]).length();
+    if (texs != nullptr) {
+        const float texExtent = std::max((texs[2] - texs[0]).length(), (texs[3] - texs[1]).length());
+        if (texExtent > 0) {
+            nn = std::max(nn, (texs[0] - texs[1] + texs[2] - texs[3]).length() * extent / texExtent);
+        }
+    }
+    if (colors != nullptr) {
+        const GColor twist = colors[0] - colors[1] + colors[2] - colors[3];
+        const float channel = std::max(std::max(std::abs(twist.a), std::abs(twist.r)),
+                                       std::max(std::abs(twist.g), std::abs(twist.b)));
+        nn = std::max(nn, channel * 255 / 4);
+    }
+
+    const float cells = std::min(std::min(ceilf(sqrtf(nn)), extent / kMinCell), kMaxCells);
+    return std::max((int)cells, 1) - 1;
+}
+
+void QuadLattice::set(const GPoint verts[4], const GColor colors[4], const GPoint texs[4], int level) {
+    const int side = level + 2;
+    if ((int)fIndices.size() <= level) {
+        fIndices.resize(level + 1);
+    }
+    std::vector<int>& indices = fIndices[level];
+    if (indices.empty()) {
+        /* each cell split on its top-right to bottom-left diagonal, row by row */
+        indices.reserve(6 * (level + 1) * (level + 1));
+        for (int i = 0; i <= level; i++) {
+            for (int j = 0; j <= level; j++) {
+                const int topLeft = i * side + j;
+                const int cell[] = { topLeft, topLeft + 1, topLeft + side,
+                                     topLeft + 1, topLeft + side + 1, topLeft + side };
+                indices.insert(indices.end(), cell, cell + 6);
+            }
+        }
+    }
+    fLevel = level;
+
+    fVerts.resize(side * side);
+    fColors.resize(colors ? side * side : 0);
+    fTexs.resize(texs ? side * side : 0);
+    int x = 0;
+    for (int i = 0; i < side; i++) {
+        float v = (float) i / (level + 1);
+        for (int j = 0; j < side; j++) {
+            float u = (float) j / (level + 1);
+            fVerts[x] = findPoint(verts, u, v);
+            if (colors != nullptr) {
+                fColors[x] = findColor(colors, u, v);
+            }
+            if (texs != nullptr) {
+                fTexs[x] = findPoint(texs, u, v);
+            }
+            x++;
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef quadLattice_DEFINED
+#define quadLattice_DEFINED
+
+#include <vector>
+
+#include "GColor.h"
+#include "GMatrix.h"
+#include "GPoint.h"
+
+/*
+ *  drawQuad's tessellation: the quad's (level + 2) x (level + 2) lattice of points (and colors
+ *  and texs), and the triangles over it, ready for drawMesh. The triangles only depend on the
+ *  level, so each level's are built the first time it is used and kept.
+ */
+class QuadLattice {
+public:
+    /*
+     *  The level for GCanvas::kAutoQuadLevel with this CTM, from how big the quad is on the
+     *  device and how far it (or its colors or texs) bends away from a parallelogram.
+     */
+    static int AutoLevel(const GMatrix& ctm, const GPoint verts[4], const GColor colors[4],
+                         const GPoint texs[4]);
+
+    /* Fills the lattice (colors and texs are null when these are) */
+    void set(const GPoint verts[4], const GColor colors[4], const GPoint texs[4], int level);
+
+    const GPoint* verts() const { return fVerts.data(); }
+    const GColor* colors() const { return fColors.empty() ? nullptr : fColors.data(); }
+    const GPoint* texs() const { return fTexs.empty() ? nullptr : fTexs.data(); }
+    int triangles() const { return (int)fIndices[fLevel].size() / 3; }
+    const int* indices() const { return fIndices[fLevel].data(); }
+
+private:
+    std::vector<std::vector<int>> fIndices;     // by level
+    std::vector<GPoint> fVerts;
+    std::vector<GColor> fColors;
+    std::vector<GPoint> fTexs;
+    int fLevel = 0;
+};
+
+#endif
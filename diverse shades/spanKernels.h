@@ -0,0 +1,214 @@
+#ifndef spanKernels_DEFINED
+#define spanKernels_DEFINED
+
+#include <stdint.h>
+
+#include "GPixel.h"
+#include "GBlendMode.h"
+#include "blendModes.h"
+
+/*
+ *  Blend mode kernels written once against a small set of vector ops, and instantiated for
+ *  each instruction set by including this file with a traits struct T that provides:
+ *
+ *      U8                  T::N pixels, 8 bits per channel
+ *      U16                 T::N / 2 pixels, 16 bits per channel
+ *      load(p), store(p, v), splat(pixel)
+ *      storeStream(p, v) (non-temporal, p aligned to a whole U8), fence()
+ *      lo(U8), hi(U8) -> U16, pack(U16, U16) -> U8
+ *      add, sub, mul (low 16 bits), div255 ((x + 128) * 257 >> 16), alpha (a in every lane)
+ *      splat16(value)
+ *
+ *  Every mode is the same math as its per-pixel proc in blendModes.cpp, so the results match
+ *  bit for bit. For premultiplied inputs no intermediate ever leaves 16 bits, e.g. for SrcATop
+ *  da * sc + (255 - sa) * dc <= da * sa + (255 - sa) * da = 255 * da.
+ *
+ *  Everything is in an anonymous namespace so each instruction set gets its own copy.
+ */
+namespace {
+
+template <typename T, int M>
+inline typename T::U16 blend16(typename T::U16 s, typename T::U16 d) {
+    typedef typename T::U16 U16;
+    const U16 k255 = T::splat16(255);
+    const U16 sa = T::alpha(s);
+    const U16 da = T::alpha(d);
+
+    switch (static_cast<GBlendMode>(M)) {
+        case GBlendMode::kClear:    return T::splat16(0);
+        case GBlendMode::kSrc:      return s;
+        case GBlendMode::kDst:      return d;
+        case GBlendMode::kSrcOver:  return T::add(s, T::div255(T::mul(T::sub(k255, sa), d)));
+        case GBlendMode::kDstOver:  return T::add(d, T::div255(T::mul(T::sub(k255, da), s)));
+        case GBlendMode::kSrcIn:    return T::div255(T::mul(da, s));
+        case GBlendMode::kDstIn:    return T::div255(T::mul(sa, d));
+        case GBlendMode::kSrcOut:   return T::div255(T::mul(T::sub(k255, da), s));
+        case GBlendMode::kDstOut:   return T::div255(T::mul(T::sub(k255, sa), d));
+        case GBlendMode::kSrcATop:  return T::div255(T::add(T::mul(da, s),
+                                                            T::mul(T::sub(k255, sa), d)));
+        case GBlendMode::kDstATop:  return T::div255(T::add(T::mul(sa, d),
+                                                            T::mul(T::sub(k255, da), s)));
+        case GBlendMode::kXor:      return T::div255(T::add(T::mul(T::sub(k255, sa), d),
+                                                            T::mul(T::sub(k255, da), s)));
+    }
+    return d;
+}
+
+template <typename T, int M>
+inline typename T::U8 blend8(typename T::U8 s, typename T::U8 d) {
+    return T::pack(blend16<T, M>(T::lo(s), T::lo(d)), blend16<T, M>(T::hi(s), T::hi(d)));
+}
+
+template <typename T, int M>
+void blendRow(const GPixel src[], GPixel dst[], int count) {
+    const int N = T::N;
+    while (count >= 2 * N) {
+        T::store(dst, blend8<T, M>(T::load(src), T::load(dst)));
+        T::store(dst + N, blend8<T, M>(T::load(src + N), T::load(dst + N)));
+        src += 2 * N;
+        dst += 2 * N;
+        count -= 2 * N;
+    }
+    if (count >= N) {
+        T::store(dst, blend8<T, M>(T::load(src), T::load(dst)));
+        src += N;
+        dst += N;
+        count -= N;
+    }
+    scalarRowProcs[M](src, dst, count);
+}
+
+template <typename T, int M>
+void blendSolid(GPixel dst[], GPixel src, int count) {
+    const int N = T::N;
+    const typename T::U8 s = T::splat(src);
+    while (count >= 2 * N) {
+        T::store(dst, blend8<T, M>(s, T::load(dst)));
+        T::store(dst + N, blend8<T, M>(s, T::load(dst + N)));
+        dst += 2 * N;
+        count -= 2 * N;
+    }
+    if (count >= N) {
+        T::store(dst, blend8<T, M>(s, T::load(dst)));
+        dst += N;
+        count -= N;
+    }
+    scalarSolidProcs[M](dst, src, count);
+}
+
+/* Clear and Src never read dst, and Dst never touches it at all */
+template <typename T>
+void fill(GPixel dst[], GPixel src, int count) {
+    const int N = T::N;
+    const typename T::U8 s = T::splat(src);
+    while (count >= 2 * N) {
+        T::store(dst, s);
+        T::store(dst + N, s);
+        dst += 2 * N;
+        count -= 2 * N;
+    }
+    for (int i = 0; i < count; i++) {
+        dst[i] = src;
+    }
+}
+
+/* fill, but with non-temporal stores once dst is aligned */
+template <typename T>
+void fillStream(GPixel dst[], GPixel src, int count) {
+    const int N = T::N;
+    while (count > 0 && ((uintptr_t)dst & (N * sizeof(GPixel) - 1))) {
+        *dst++ = src;
+        count--;
+    }
+    const typename T::U8 s = T::splat(src);
+    while (count >= N) {
+        T::storeStream(dst, s);
+        dst += N;
+        count -= N;
+    }
+    T::fence();
+    for (int i = 0; i < count; i++) {
+        dst[i] = src;
+    }
+}
+
+template <typename T>
+void blendRowClear(const GPixel src[], GPixel dst[], int count) {
+    fill<T>(dst, 0, count);
+}
+
+template <typename T>
+void blendSolidClear(GPixel dst[], GPixel src, int count) {
+    fill<T>(dst, 0, count);
+}
+
+template <typename T>
+void blendRowSrc(const GPixel src[], GPixel dst[], int count) {
+    const int N = T::N;
+    while (count >= N) {
+        T::store(dst, T::load(src));
+        src += N;
+        dst += N;
+        count -= N;
+    }
+    for (int i = 0; i < count; i++) {
+        dst[i] = src[i];
+    }
+}
+
+template <typename T>
+void blendSolidSrc(GPixel dst[], GPixel src, int count) {
+    fill<T>(dst, src, count);
+}
+
+template <typename T>
+void blendRowDst(const GPixel src[], GPixel dst[], int count) {}
+
+template <typename T>
+void blendSolidDst(GPixel dst[], GPixel src, int count) {}
+
+/* dst[i] = src[i] * dst[i], channel by channel, as my_compositeShader::multPixels does it */
+inline void modulateRowScalar(const GPixel src[], GPixel dst[], int count) {
+    for (int i = 0; i < count; i++) {
+        GPixel result = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            result |= (GPixel)dividePixel(((src[i] >> shift) & 0xFF) * ((dst[i] >> shift) & 0xFF)) << shift;
+        }
+        dst[i] = result;
+    }
+}
+
+template <typename T>
+void modulateRow(const GPixel src[], GPixel dst[], int count) {
+    const int N = T::N;
+    while (count >= N) {
+        const typename T::U8 s = T::load(src);
+        const typename T::U8 d = T::load(dst);
+        T::store(dst, T::pack(T::div255(T::mul(T::lo(s), T::lo(d))),
+                              T::div255(T::mul(T::hi(s), T::hi(d)))));
+        src += N;
+        dst += N;
+        count -= N;
+    }
+    modulateRowScalar(src, dst, count);
+}
+
+template <typename T>
+void fillProcs(blendRowProc row[], blendSolidProc solid[]) {
+    row[0] = blendRowClear<T>;  solid[0] = blendSolidClear<T>;
+    row[1] = blendRowSrc<T>;    solid[1] = blendSolidSrc<T>;
+    row[2] = blendRowDst<T>;    solid[2] = blendSolidDst<T>;
+    row[3] = blendRow<T, 3>;    solid[3] = blendSolid<T, 3>;
+    row[4] = blendRow<T, 4>;    solid[4] = blendSolid<T, 4>;
+    row[5] = blendRow<T, 5>;    solid[5] = blendSolid<T, 5>;
+    row[6] = blendRow<T, 6>;    solid[6] = blendSolid<T, 6>;
+    row[7] = blendRow<T, 7>;    solid[7] = blendSolid<T, 7>;
+    row[8] = blendRow<T, 8>;    solid[8] = blendSolid<T, 8>;
+    row[9] = blendRow<T, 9>;    solid[9] = blendSolid<T, 9>;
+    row[10] = blendRow<T, 10>;  solid[10] = blendSolid<T, 10>;
+    row[11] = blendRow<T, 11>;  solid[11] = blendSolid<T, 11>;
+}
+
+}
+
+#endif
@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "GPixel.h"
+#include "blendModes.h"
+#include "spans.h"
+
+#if defined(__SSE2__)
+    #define SPANS_X86
+    #include <immintrin.h>
+#elif defined(__ARM_NEON)
+    #define SPANS_NEON
+    #include <arm_neon.h>
+#endif
+
+#ifdef SPANS_X86
+
+#include "filterKernels.h"
+#include "spanKernels.h"
+
+/* 4 pixels per U8, channels widened to 16 bit lanes 2 pixels at a time */
+struct SSE2 {
+    typedef __m128i U8;
+    typedef __m128i U16;
+    enum { N = 4 };
+
+    static U8 load(const GPixel* p) { return _mm_loadu_si128((const __m128i*)p); }
+    static void store(GPixel* p, U8 v) { _mm_storeu_si128((__m128i*)p, v); }
+    static U8 splat(GPixel p) { return _mm_set1_epi32(p); }
+    static void storeStream(GPixel* p, U8 v) { _mm_stream_si128((__m128i*)p, v); }
+    static void fence() { _mm_sfence(); }
+
+    static U16 lo(U8 v) { return _mm_unpacklo_epi8(v, _mm_setzero_si128()); }
+    static U16 hi(U8 v) { return _mm_unpackhi_epi8(v, _mm_setzero_si128()); }
+    static U8 pack(U16 l, U16 h) { return _mm_packus_epi16(l, h); }
+
+    static U16 splat16(int v) { return _mm_set1_epi16(v); }
+    static U16 add(U16 a, U16 b) { return _mm_add_epi16(a, b); }
+    static U16 sub(U16 a, U16 b) { return _mm_sub_epi16(a, b); }
+    static U16 mul(U16 a, U16 b) { return _mm_mullo_epi16(a, b); }
+    static U16 div255(U16 v) {
+        return _mm_mulhi_epu16(_mm_add_epi16(v, _mm_set1_epi16(128)), _mm_set1_epi16(257));
+    }
+    /* a is the top 16 bit lane of each pixel */
+    static U16 alpha(U16 v) {
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xFF), 0xFF);
+    }
+
+    /* filterKernels.h, one pixel at a time */
+    typedef __m128i I32;
+    enum { P = 1 };
+
+    static U8 loadTaps(const GPixel* p, int stride) { return load(p); }
+    static U16 loadWeights(const int16_t* w, int stride) {
+        return _mm_loadl_epi64((const __m128i*)w);
+    }
+    static U8 swapMiddle(U8 v) { return _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0)); }
+    static U8 interleave8(U8 a, U8 b) { return _mm_unpacklo_epi8(a, b); }
+    static U8 upper64(U8 v) { return _mm_srli_si128(v, 8); }
+    static U16 pair0(U16 w) { return _mm_shuffle_epi32(w, 0x00); }
+    static U16 pair1(U16 w) { return _mm_shuffle_epi32(w, 0x55); }
+    static I32 madd(U16 a, U16 b) { return _mm_madd_epi16(a, b); }
+    static I32 add32(I32 a, I32 b) { return _mm_add_epi32(a, b); }
+    static I32 splat32(int v) { return _mm_set1_epi32(v); }
+    static I32 shr32(I32 v, int bits) { return _mm_srai_epi32(v, bits); }
+    static U16 packs32(I32 a, I32 b) { return _mm_packs_epi32(a, b); }
+    static U16 min16(U16 a, U16 b) { return _mm_min_epi16(a, b); }
+    static U16 max16(U16 a, U16 b) { return _mm_max_epi16(a, b); }
+    static void storeFiltered(GPixel* row, U8 v) { *row = _mm_cvtsi128_si32(v); }
+    static U16 unpackLo64(U16 a, U16 b) { return _mm_unpacklo_epi64(a, b); }
+    static U16 unpackHi64(U16 a, U16 b) { return _mm_unpackhi_epi64(a, b); }
+    static U16 shr16(U16 v, int bits) { return _mm_srli_epi16(v, bits); }
+    static void storeLowHalf(GPixel* dst, U8 v) { _mm_storel_epi64((__m128i*)dst, v); }
+};
+
+#endif
+
+#ifdef SPANS_NEON
+
+/* (x * 257) >> 16 == (x + (x >> 8)) >> 8 for every x we can produce here (x <= 65153) */
+static void srcOverSolid_neon(GPixel dst[], GPixel src, int count) {
+    const uint8x16_t s = vreinterpretq_u8_u32(vdupq_n_u32(src));
+    const uint8x8_t invA = vdup_n_u8(255 - GPixel_GetA(src));
+    const uint16x8_t k128 = vdupq_n_u16(128);
+
+    while (count >= 4) {
+        uint8x16_t d = vld1q_u8((const uint8_t*)dst);
+        uint16x8_t lo = vmlal_u8(k128, vget_low_u8(d), invA);
+        uint16x8_t hi = vmlal_u8(k128, vget_high_u8(d), invA);
+        uint8x8_t rlo = vshrn_n_u16(vsraq_n_u16(lo, lo, 8), 8);
+        uint8x8_t rhi = vshrn_n_u16(vsraq_n_u16(hi, hi, 8), 8);
+        vst1q_u8((uint8_t*)dst, vaddq_u8(vcombine_u8(rlo, rhi), s));
+        dst += 4;
+        count -= 4;
+    }
+    scalarSolidProcs[static_cast<int>(GBlendMode::kSrcOver)](dst, src, count);
+}
+
+static void srcSolid_neon(GPixel dst[], GPixel src, int count) {
+    const uint32x4_t s = vdupq_n_u32(src);
+
+    while (count >= 4) {
+        vst1q_u32(dst, s);
+        dst += 4;
+        count -= 4;
+    }
+    scalarSolidProcs[static_cast<int>(GBlendMode::kSrc)](dst, src, count);
+}
+
+#endif
+
+/* 2 pixels per store */
+static void fill64(GPixel dst[], GPixel src, int count) {
+    if (count > 0 && ((uintptr_t)dst & 7)) {
+        *dst++ = src;
+        count--;
+    }
+    const uint64_t pair = (uint64_t)src << 32 | src;
+    while (count >= 2) {
+        memcpy(dst, &pair, sizeof(pair));
+        dst += 2;
+        count -= 2;
+    }
+    if (count > 0) {
+        *dst = src;
+    }
+}
+
+static SpanProcs pickSpanProcs() {
+    SpanProcs procs;
+    procs.name = "scalar";
+    for (int i = 0; i < kBlendModeCount; i++) {
+        procs.row[i] = scalarRowProcs[i];
+        procs.solid[i] = scalarSolidProcs[i];
+    }
+    procs.fillStream = fill64;
+    procs.bilerp = filterRowScalar<1>;
+    procs.bicubic = filterRowScalar<4>;
+    procs.downsample = downsample2x2Scalar;
+    procs.modulate = modulateRowScalar;
+
+#if defined(SPANS_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        procs.name = "avx2";
+        fillAVX2Procs(&procs);
+    }
+    else {
+        procs.name = "sse2";
+        fillProcs<SSE2>(procs.row, procs.solid);
+        procs.fillStream = fillStream<SSE2>;
+        procs.bilerp = filterRow<SSE2, 1>;
+        procs.bicubic = filterRow<SSE2, 4>;
+        procs.downsample = downsample2x2<SSE2>;
+        procs.modulate = modulateRow<SSE2>;
+    }
+#elif defined(SPANS_NEON)
+    /* only the solid SrcOver/Src kernels have NEON versions so far */
+    procs.name = "neon";
+    procs.solid[static_cast<int>(GBlendMode::kSrcOver)] = srcOverSolid_neon;
+    procs.solid[static_cast<int>(GBlendMode::kSrc)] = srcSolid_neon;
+    procs.fillStream = srcSolid_neon;
+#endif
+    return procs;
+}
+
+const SpanProcs& getSpanProcs() {
+    static const SpanProcs procs = pickSpanProcs();
+    return procs;
+}
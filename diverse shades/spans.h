@@ -0,0 +1,42 @@
+#ifndef spans_DEFINED
+#define spans_DEFINED
+
+#include <stdint.h>
+
+#include "GPixel.h"
+#include "blendModes.h"
+
+/* Filters count pixels from their taps and weights, see filterKernels.h */
+typedef void(*filterRowProc)(const GPixel taps[], const int16_t weights[], int count, GPixel row[]);
+
+/* dst[i] is the average of pixels 2i and 2i + 1 of both rows, see mipmap.h */
+typedef void(*downsampleProc)(const GPixel row0[], const GPixel row1[], GPixel dst[], int count);
+
+/* One set of span procs for every blend mode, all built for the same instruction set */
+struct SpanProcs {
+    const char* name;
+    blendRowProc row[kBlendModeCount];
+    blendSolidProc solid[kBlendModeCount];
+
+    /* Stores src to every pixel, bypassing the cache where the CPU can. Only worth it for fills
+       much bigger than the cache, since whatever draws next has to read them back from memory. */
+    blendSolidProc fillStream;
+
+    /* Bitmap filtering, 4 taps (bilinear) or 16 taps (bicubic) per pixel */
+    filterRowProc bilerp;
+    filterRowProc bicubic;
+
+    /* One row of the next mip level */
+    downsampleProc downsample;
+
+    /* dst[i] = src[i] * dst[i], channel by channel, for composed shaders */
+    blendRowProc modulate;
+};
+
+/* Fills in the AVX2 procs (spansAVX2.cpp), only call this if the CPU has AVX2 */
+void fillAVX2Procs(SpanProcs* procs);
+
+/* The widest procs this CPU supports, picked once on first use */
+const SpanProcs& getSpanProcs();
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ *  The AVX2 span procs. Everything in this file is compiled for AVX2, so only call into it
+ *  after checking the CPU supports it (see getSpanProcs()).
+ */
+#if defined(__SSE2__)
+
+#include <immintrin.h>
+
+#include "GPixel.h"
+#include "blendModes.h"
+#include "spans.h"
+
+/* shared headers come first so none of their inline code gets built for AVX2 */
+#if defined(__clang__)
+    #pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx2")
+#endif
+
+#include "filterKernels.h"
+#include "spanKernels.h"
+
+/* 8 pixels per U8. unpack/pack work within each 128 bit half, so pixel order is unchanged. */
+struct AVX2 {
+    typedef __m256i U8;
+    typedef __m256i U16;
+    enum { N = 8 };
+
+    static U8 load(const GPixel* p) { return _mm256_loadu_si256((const __m256i*)p); }
+    static void store(GPixel* p, U8 v) { _mm256_storeu_si256((__m256i*)p, v); }
+    static U8 splat(GPixel p) { return _mm256_set1_epi32(p); }
+    static void storeStream(GPixel* p, U8 v) { _mm256_stream_si256((__m256i*)p, v); }
+    static void fence() { _mm_sfence(); }
+
+    static U16 lo(U8 v) { return _mm256_unpacklo_epi8(v, _mm256_setzero_si256()); }
+    static U16 hi(U8 v) { return _mm256_unpackhi_epi8(v, _mm256_setzero_si256()); }
+    static U8 pack(U16 l, U16 h) { return _mm256_packus_epi16(l, h); }
+
+    static U16 splat16(int v) { return _mm256_set1_epi16(v); }
+    static U16 add(U16 a, U16 b) { return _mm256_add_epi16(a, b); }
+    static U16 sub(U16 a, U16 b) { return _mm256_sub_epi16(a, b); }
+    static U16 mul(U16 a, U16 b) { return _mm256_mullo_epi16(a, b); }
+    static U16 div255(U16 v) {
+        return _mm256_mulhi_epu16(_mm256_add_epi16(v, _mm256_set1_epi16(128)),
+                                  _mm256_set1_epi16(257));
+    }
+    static U16 alpha(U16 v) {
+        return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, 0xFF), 0xFF);
+    }
+
+    /* filterKernels.h, two pixels at a time, one in each 128 bit half */
+    typedef __m256i I32;
+    enum { P = 2 };
+
+    static U8 loadTaps(const GPixel* p, int stride) {
+        return _mm256_loadu2_m128i((const __m128i*)(p + stride), (const __m128i*)p);
+    }
+    static U16 loadWeights(const int16_t* w, int stride) {
+        return _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)w)),
+                _mm_loadl_epi64((const __m128i*)(w + stride)), 1);
+    }
+    static U8 swapMiddle(U8 v) { return _mm256_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0)); }
+    static U8 interleave8(U8 a, U8 b) { return _mm256_unpacklo_epi8(a, b); }
+    static U8 upper64(U8 v) { return _mm256_srli_si256(v, 8); }
+    static U16 pair0(U16 w) { return _mm256_shuffle_epi32(w, 0x00); }
+    static U16 pair1(U16 w) { return _mm256_shuffle_epi32(w, 0x55); }
+    static I32 madd(U16 a, U16 b) { return _mm256_madd_epi16(a, b); }
+    static I32 add32(I32 a, I32 b) { return _mm256_add_epi32(a, b); }
+    static I32 splat32(int v) { return _mm256_set1_epi32(v); }
+    static I32 shr32(I32 v, int bits) { return _mm256_srai_epi32(v, bits); }
+    static U16 packs32(I32 a, I32 b) { return _mm256_packs_epi32(a, b); }
+    static U16 min16(U16 a, U16 b) { return _mm256_min_epi16(a, b); }
+    static U16 max16(U16 a, U16 b) { return _mm256_max_epi16(a, b); }
+    static void storeFiltered(GPixel* row, U8 v) {
+        row[0] = _mm256_extract_epi32(v, 0);
+        row[1] = _mm256_extract_epi32(v, 4);
+    }
+    static U16 unpackLo64(U16 a, U16 b) { return _mm256_unpacklo_epi64(a, b); }
+    static U16 unpackHi64(U16 a, U16 b) { return _mm256_unpackhi_epi64(a, b); }
+    static U16 shr16(U16 v, int bits) { return _mm256_srli_epi16(v, bits); }
+    /* the low 64 bits of each half are next to each other after the permute */
+    static void storeLowHalf(GPixel* dst, U8 v) {
+        _mm_storeu_si128((__m128i*)dst,
+                         _mm256_castsi256_si128(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+};
+
+void fillAVX2Procs(SpanProcs* procs) {
+    fillProcs<AVX2>(procs->row, procs->solid);
+    procs->fillStream = fillStream<AVX2>;
+    procs->bilerp = filterRow<AVX2, 1>;
+    procs->bicubic = filterRow<AVX2, 4>;
+    procs->downsample = downsample2x2<AVX2>;
+    procs->modulate = modulateRow<AVX2>;
+}
+
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+
+#else
+
+#include "spans.h"
+
+void fillAVX2Procs(SpanProcs* procs) {}
+
+#endif
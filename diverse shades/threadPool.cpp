@@ -0,0 +1,99 @@
+#include "threadPool.h"
+
+ThreadPool::ThreadPool(int threads) {
+    threads = std::max(1, threads);
+    for (int i = 0; i < threads; i++) {
+        fQueues.push_back(std::unique_ptr<Queue>(new Queue));
+    }
+    for (int i = 1; i < threads; i++) {
+        fThreads.push_back(std::thread(&ThreadPool::loop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fQuit = true;
+    }
+    fWake.notify_all();
+    for (std::thread& t : fThreads) {
+        t.join();
+    }
+}
+
+void ThreadPool::run(int count, const std::function<void(int, int)>& job) {
+    if (count <= 0) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        Queue& q = *fQueues[i % fQueues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.jobs.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fJob = &job;
+        fBusy = (int)fThreads.size();
+        fGeneration++;
+    }
+    fWake.notify_all();
+
+    work(0);
+
+    /* wait for every worker to go idle, so none of them is still holding on to job */
+    std::unique_lock<std::mutex> lock(fMutex);
+    fDone.wait(lock, [this] { return fBusy == 0; });
+    fJob = nullptr;
+}
+
+bool ThreadPool::next(int worker, int* index) {
+    const int n = (int)fQueues.size();
+    {
+        Queue& own = *fQueues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            *index = own.jobs.back();
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+    for (int i = 1; i < n; i++) {
+        Queue& other = *fQueues[(worker + i) % n];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.jobs.empty()) {
+            *index = other.jobs.front();
+            other.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::work(int worker) {
+    int index;
+    while (next(worker, &index)) {
+        (*fJob)(index, worker);
+    }
+}
+
+void ThreadPool::loop(int worker) {
+    int seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(fMutex);
+            fWake.wait(lock, [&] { return fQuit || fGeneration != seen; });
+            if (fQuit) {
+                return;
+            }
+            seen = fGeneration;
+        }
+
+        work(worker);
+
+        std::lock_guard<std::mutex> lock(fMutex);
+        if (--fBusy == 0) {
+            fDone.notify_one();
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef threadPool_DEFINED
+#define threadPool_DEFINED
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ *  A small work-stealing pool. run() deals the jobs out round-robin to one queue per worker,
+ *  each worker pops from the back of its own queue and steals from the front of the others
+ *  when it runs dry. The calling thread works too, as worker 0.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    int threads() const { return (int)fQueues.size(); }
+
+    /* Calls job(index, worker) for every index in [0, count) and returns once they are all done */
+    void run(int count, const std::function<void(int, int)>& job);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> jobs;
+    };
+
+    bool next(int worker, int* index);
+    void work(int worker);
+    void loop(int worker);
+
+    std::vector<std::unique_ptr<Queue>> fQueues;
+    std::vector<std::thread> fThreads;
+
+    std::mutex fMutex;
+    std::condition_variable fWake;
+    std::condition_variable fDone;
+    const std::function<void(int, int)>* fJob = nullptr;
+    int fGeneration = 0;
+    int fBusy = 0;
+    bool fQuit = false;
+};
+
+#endif
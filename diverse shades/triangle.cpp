@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cmath>
+
+#include "triangle.h"
+
+/* 8 bits of subpixel precision: pixel centers are at 256 * x + 128 */
+static int64_t toFixed(float v) {
+    return (int64_t)floor((double)v * 256 + 0.5);
+}
+
+static int64_t floorDiv(int64_t a, int64_t b) {
+    assert(b > 0);
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+bool TriangleRaster::Fits(const GPoint pts[3]) {
+    /* 2^28 in fixed point, so the products in the edge functions stay under 2^60 */
+    const float kMax = 1 << 20;
+    for (int i = 0; i < 3; i++) {
+        /* false for NaN too */
+        if (!(std::abs(pts[i].fX) <= kMax && std::abs(pts[i].fY) <= kMax)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TriangleRaster::set(const GPoint pts[3], const GIRect& clip) {
+    assert(Fits(pts));
+    int64_t x[3], y[3];
+    for (int i = 0; i < 3; i++) {
+        x[i] = toFixed(pts[i].fX);
+        y[i] = toFixed(pts[i].fY);
+    }
+
+    /* wind the vertices so each edge's function is positive towards the third vertex */
+    const int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0) {
+        return false;
+    }
+    if (area < 0) {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+    }
+
+    /* rows whose centers are within the vertices' y range */
+    const int64_t minY = std::min(y[0], std::min(y[1], y[2]));
+    const int64_t maxY = std::max(y[0], std::max(y[1], y[2]));
+    fTop = (int)std::max((int64_t)clip.fTop, -floorDiv(128 - minY, 256));
+    fBottom = (int)std::min((int64_t)clip.fBottom, floorDiv(maxY - 128, 256) + 1);
+    if (fTop >= fBottom || clip.fLeft >= clip.fRight) {
+        return false;
+    }
+    fClip = clip;
+
+    const int64_t py = (int64_t)fTop * 256 + 128;
+    for (int i = 0; i < 3; i++) {
+        const int j = (i + 1) % 3;
+        const int64_t dx = x[j] - x[i];
+        const int64_t dy = y[j] - y[i];
+        /* centers on the edge are in when it's the triangle's left edge, or its top one */
+        const int64_t owns = dy < 0 || (dy == 0 && dx > 0);
+        EdgeFn& e = fEdges[i];
+        /* the edge function at (256 * x + 128, py) is dx * (py - y) - dy * (256 * x + 128 - x) */
+        e.k = dx * (py - y[i]) - dy * (128 - x[i]) + owns - 1;
+        e.stepK = 256 * dx;
+        e.dy = dy;
+    }
+    return true;
+}
+
+void TriangleRaster::blit(GBlitter* blitter) const {
+    int64_t k[3] = { fEdges[0].k, fEdges[1].k, fEdges[2].k };
+    for (int y = fTop; y < fBottom; y++) {
+        int64_t left = fClip.fLeft;
+        int64_t right = fClip.fRight;
+        for (int i = 0; i < 3; i++) {
+            const int64_t dy = fEdges[i].dy;
+            if (dy > 0) {
+                /* the last x with k - 256 * dy * x >= 0 */
+                right = std::min(right, floorDiv(k[i], 256 * dy) + 1);
+            }
+            else if (dy < 0) {
+                /* the first one */
+                left = std::max(left, -floorDiv(k[i], -256 * dy));
+            }
+            else if (k[i] < 0) {
+                right = left;
+            }
+            k[i] += fEdges[i].stepK;
+        }
+        if (left < right) {
+            blitter->blitH((int)left, y, (int)(right - left));
+        }
+    }
+}
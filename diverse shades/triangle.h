@@ -0,0 +1,47 @@
+#ifndef triangle_DEFINED
+#define triangle_DEFINED
+
+#include <stdint.h>
+
+#include "GPoint.h"
+#include "GRect.h"
+#include "blitter.h"
+
+/*
+ *  Scan converts one triangle of a mesh. The polygon path clips every edge, sorts them, and
+ *  walks them in float, which costs more than the few pixels a mesh triangle usually covers.
+ *
+ *  Here the vertices are snapped to 1/256 of a pixel, so each edge's function (positive on the
+ *  triangle's side of it) is exact in 64 bit integers. A row's span is where all three are
+ *  positive, found with one division per slanted edge rather than by testing pixels, and rows
+ *  and spans are clamped to the clip rather than clipping the triangle.
+ *
+ *  A pixel center exactly on an edge belongs to just one of the two triangles that share it,
+ *  so a mesh never blends a pixel twice or leaves a crack: the top-left rule gives it to the
+ *  triangle the edge is a top or left edge of.
+ */
+class TriangleRaster {
+public:
+    /* Whether pts (device space) are small enough for the edge functions to stay exact */
+    static bool Fits(const GPoint pts[3]);
+
+    /* Sets up pts (which must fit), or returns false if it has no area or misses clip's rows */
+    bool set(const GPoint pts[3], const GIRect& clip);
+
+    /* Covers the triangle, one blitH per row */
+    void blit(GBlitter* blitter) const;
+
+private:
+    struct EdgeFn {
+        /* k - 256 * dy * x >= 0 for the pixel centers x on the current row inside this edge */
+        int64_t k;
+        int64_t stepK;   // k's change from one row to the next
+        int64_t dy;
+    };
+
+    EdgeFn fEdges[3];
+    GIRect fClip;
+    int fTop, fBottom;
+};
+
+#endif